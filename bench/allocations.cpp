@@ -0,0 +1,82 @@
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+#include "scene.h"
+
+// Counts the calls to the global operator new made while rendering the demo
+// scene at increasing sample counts. Allocations made once per frame, such as
+// the film, the tile list and the worker threads, show up in every row;
+// allocations made while tracing show up as a cost per sample. The PNG encoder
+// uses malloc and is not counted.
+//
+// Usage: bench_allocations [image width]
+
+namespace {
+// Heap allocations made through operator new since the program started.
+std::atomic<unsigned long> allocations = 0;
+}  // namespace
+
+void *operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+// Build the scene from src/main.cpp with the given viewport.
+Scene demoScene(const Viewport &vp) {
+    MaterialTable materials;
+    MaterialId m1 = materials.add(Material::from(MaterialType::Glass, Color::grey()));
+    MaterialId m2 = materials.add(Material::from(MaterialType::PolishedMetal, Color::grey()));
+    MaterialId m3 = materials.add(Material::from(MaterialType::Plastic, Color::white()));
+    MaterialId m4 = materials.add(Material::from(MaterialType::Plastic, Color(0.9803, 0.501, 0.447)));
+    MaterialId m5 = materials.add(Material::from(MaterialType::Plastic, Color(0.341, 0.463, 0.831)));
+
+    std::vector<std::shared_ptr<Object>> objs{
+        std::make_shared<Object>(std::make_shared<Sphere>(Pnt3(1.0, -0.7, -1.0), 0.7), m1),
+        std::make_shared<Object>(std::make_shared<Sphere>(Pnt3(-1.0, -0.4, -2.5), 0.9), m2),
+        std::make_shared<Object>(std::make_shared<Sphere>(Pnt3(0, -500.5, -30), 500), m3),
+        std::make_shared<Object>(std::make_shared<Sphere>(Pnt3(-501.5, 0, 40), 500), m4),
+        std::make_shared<Object>(std::make_shared<Sphere>(Pnt3(501.5, 0, 40), 500), m5),
+        std::make_shared<Object>(std::make_shared<Sphere>(Pnt3(0, 0, -505.5), 500), m3),
+    };
+
+    std::vector<std::shared_ptr<Light>> lights;
+    lights.push_back(std::make_shared<SquareLight>(10, Pnt3(0, 2.0, -1.0), Color(1, 1, 1),
+                                                   Vec3(0, -2, 2).normalize(), 1));
+
+    Camera cam(vp, Pnt3(0, 0, 3), 1);
+    return Scene(objs, materials, lights, cam);
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    int width = argc > 1 ? std::atoi(argv[1]) : 160;
+    Viewport vp(2, width, 16.0 / 9.0);
+    Scene scene = demoScene(vp);
+    int height = vp.getImg()->getHeight();
+    double pixels = double(width) * height;
+
+    std::cout << width << "x" << height << " image" << std::endl;
+    unsigned long baseline = 0;
+    for (unsigned samples : {1u, 2u, 4u, 8u}) {
+        unsigned long before = allocations;
+        scene.render("bench_allocations.png", RenderSettings(samples));
+        unsigned long made = allocations - before;
+        if (samples == 1) baseline = made;
+
+        std::cout << "  " << samples << " spp: " << made << " allocations";
+        if (samples > 1) {
+            std::cout << ", " << double(made - baseline) / ((samples - 1) * pixels)
+                      << " per extra sample";
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "scene.h"
+
+// Times Scene::intersect on one batch of compact rays against Scene::castRay
+// on the same rays, and checks that the two agree on what was hit.
+//
+// The rays leave the camera of the demo scene in random directions, so they
+// hit the small spheres as well as the large walls, whose radius of 500 is
+// where single precision has the least to spare.
+//
+// Usage: bench_compact [rays]
+
+namespace {
+Scene demoScene() {
+    MaterialTable materials;
+    MaterialId m = materials.add(Material::from(MaterialType::Plastic, Color::white()));
+
+    std::vector<std::shared_ptr<Object>> objs{
+        std::make_shared<Object>(std::make_shared<Sphere>(Pnt3(1.0, -0.7, -1.0), 0.7), m),
+        std::make_shared<Object>(std::make_shared<Sphere>(Pnt3(-1.0, -0.4, -2.5), 0.9), m),
+        std::make_shared<Object>(std::make_shared<Sphere>(Pnt3(0, -500.5, -30), 500), m),
+        std::make_shared<Object>(std::make_shared<Sphere>(Pnt3(-501.5, 0, 40), 500), m),
+        std::make_shared<Object>(std::make_shared<Sphere>(Pnt3(501.5, 0, 40), 500), m),
+        std::make_shared<Object>(std::make_shared<Sphere>(Pnt3(0, 0, -505.5), 500), m),
+    };
+    std::vector<std::shared_ptr<Light>> lights;
+    Viewport vp(2, 16, 16.0 / 9.0);
+    Camera cam(vp, Pnt3(0, 0, 3), 1);
+    return Scene(objs, materials, lights, cam);
+}
+
+template <typename F>
+double nsPerRay(size_t rays, F f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / rays;
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    size_t count = argc > 1 ? std::atol(argv[1]) : 2000000;
+    Scene scene = demoScene();
+
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<Real> unit(-1, 1);
+    std::vector<Ray> rays(count);
+    std::vector<CompactRay> compactRays(count);
+    for (size_t i = 0; i < count; ++i) {
+        rays[i] = Ray{Pnt3{0, 0, 3}, Vec3(unit(gen), unit(gen), unit(gen)).normalize()};
+        compactRays[i] = CompactRay::from(rays[i]);
+    }
+
+    std::cout << "record sizes: Ray " << sizeof(Ray) << " B, Hit " << sizeof(Hit)
+              << " B, CompactRay " << sizeof(CompactRay) << " B, CompactHit "
+              << sizeof(CompactHit) << " B" << std::endl;
+
+    std::vector<std::optional<Hit>> hits(count);
+    double scalar = nsPerRay(count, [&] {
+        for (size_t i = 0; i < count; ++i) hits[i] = scene.castRay(rays[i]);
+    });
+
+    Arena arena;
+    std::vector<CompactHit> compactHits(count);
+    double batched = nsPerRay(count, [&] { scene.intersect(compactRays, compactHits, arena); });
+    double coords = nsPerRay(count, [&] { scene.surfaceCoords(compactRays, compactHits); });
+
+    // Compare the hits. Distances are compared relative to the distance found
+    // in double precision.
+    size_t agree = 0;
+    double maxError = 0;
+    for (size_t i = 0; i < count; ++i) {
+        bool hit = compactHits[i].primitive != CompactHit::NONE;
+        if (hit != hits[i].has_value()) continue;
+        if (!hit) {
+            ++agree;
+            continue;
+        }
+        if (compactHits[i].primitive != hits[i]->primitive.pack()) continue;
+        ++agree;
+        maxError = std::max<double>(maxError, std::abs(compactHits[i].t - hits[i]->minusT) /
+                                                      hits[i]->minusT);
+    }
+
+    std::cout << count << " rays in one batch" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "  castRay   " << scalar << " ns/ray" << std::endl;
+    std::cout << "  intersect " << batched << " ns/ray, then surfaceCoords " << coords
+              << " ns/ray" << std::endl;
+    std::cout << std::defaultfloat << std::setprecision(4);
+    std::cout << "  same primitive for " << 100.0 * agree / count
+              << "% of rays, max relative error of t " << maxError << std::endl;
+    return 0;
+}
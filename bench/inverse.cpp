@@ -0,0 +1,184 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "geometry.h"
+
+// Checks the precision of Mat4T::inverse on random affine transforms and times
+// it against the rotation-times-scale decomposition it replaced.
+//
+// Three families of transforms are tested. "scale" is a non-uniform scale and
+// translation, the only form the decomposition inverts correctly. "rotation *
+// scale" rotates after scaling. "arbitrary" stacks rotations, non-uniform
+// scales and shears in any order, as Geometry::setCoordSystem can produce.
+//
+// Usage: bench_inverse [count]
+
+namespace {
+// The inverse from before general affine matrices were supported. It assumes
+// the linear part is a rotation followed by a diagonal scale.
+template <typename T>
+Mat4T<T> decompositionInverse(const Mat4T<T> &m) {
+    Mat3T<T> linear = m.extractLinear();
+    Mat3T<T> inverseScale = linear.extractScaling();
+    inverseScale.setReciprocalDiag();
+    Mat3T<T> inverseRot = inverseScale * linear;
+    inverseRot.transpose();
+    Mat3T<T> inverseRotScale = inverseRot * inverseScale;
+    Vec3T<T> inverseTrans = inverseRotScale * Vec3T<T>{-m[0][3], -m[1][3], -m[2][3]};
+    return Mat4T<T>{inverseRotScale, inverseTrans};
+}
+
+// Return a rotation of angle radians about a unit axis (Rodrigues' formula).
+template <typename T>
+Mat3T<T> rotation(Vec3T<T> axis, T angle) {
+    T c = std::cos(angle), s = std::sin(angle), t = 1 - c;
+    Mat3T<T> m{};
+    m[0][0] = c + t * axis.x * axis.x;
+    m[0][1] = t * axis.x * axis.y - s * axis.z;
+    m[0][2] = t * axis.x * axis.z + s * axis.y;
+    m[1][0] = t * axis.x * axis.y + s * axis.z;
+    m[1][1] = c + t * axis.y * axis.y;
+    m[1][2] = t * axis.y * axis.z - s * axis.x;
+    m[2][0] = t * axis.x * axis.z - s * axis.y;
+    m[2][1] = t * axis.y * axis.z + s * axis.x;
+    m[2][2] = c + t * axis.z * axis.z;
+    return m;
+}
+
+template <typename T>
+class TransformGenerator {
+private:
+    std::mt19937_64 gen{7};
+    std::uniform_real_distribution<double> unit{0, 1};
+
+    T uniform(double min, double max) { return T(min + (max - min) * unit(gen)); }
+
+    Mat3T<T> randomRotation() {
+        T z = uniform(-1, 1), phi = uniform(0, 2 * M_PI);
+        T r = std::sqrt(1 - z * z);
+        Vec3T<T> axis(r * std::cos(phi), r * std::sin(phi), z);
+        return rotation(axis, uniform(0, 2 * M_PI));
+    }
+
+    Mat3T<T> randomScale() {
+        Mat3T<T> m{};
+        // Log-uniform between 0.1 and 10.
+        for (int i = 0; i < 3; ++i) m[i][i] = T(std::pow(10.0, uniform(-1, 1)));
+        return m;
+    }
+
+    Mat3T<T> randomShear() {
+        Mat3T<T> m = Mat3T<T>::identity();
+        int i = static_cast<int>(unit(gen) * 3) % 3;
+        int j = (i + 1 + static_cast<int>(unit(gen) * 2) % 2) % 3;
+        m[i][j] = uniform(-2, 2);
+        return m;
+    }
+
+    Vec3T<T> randomTranslation() {
+        return Vec3T<T>(uniform(-100, 100), uniform(-100, 100), uniform(-100, 100));
+    }
+
+public:
+    Mat4T<T> scale() { return Mat4T<T>{randomScale(), randomTranslation()}; }
+
+    Mat4T<T> rotationScale() {
+        return Mat4T<T>{randomRotation() * randomScale(), randomTranslation()};
+    }
+
+    Mat4T<T> arbitrary() {
+        Mat3T<T> linear = Mat3T<T>::identity();
+        for (int k = 0; k < 4; ++k) {
+            switch (static_cast<int>(unit(gen) * 3) % 3) {
+                case 0: linear = randomRotation() * linear; break;
+                case 1: linear = randomScale() * linear; break;
+                default: linear = randomShear() * linear; break;
+            }
+        }
+        return Mat4T<T>{linear, randomTranslation()};
+    }
+};
+
+// Return the largest absolute error of m * inverse relative to the identity.
+template <typename T>
+double identityError(const Mat4T<T> &m, const Mat4T<T> &inverse) {
+    Mat4T<T> product = m * inverse;
+    double error = 0;
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            double expected = i == j ? 1 : 0;
+            error = std::max(error, std::abs(double(product[i][j]) - expected));
+        }
+    }
+    return error;
+}
+
+template <typename T, typename Invert>
+void reportPrecision(const char *family, const char *method,
+                     const std::vector<Mat4T<T>> &matrices, Invert invert) {
+    double maxError = 0, sumError = 0;
+    for (const Mat4T<T> &m : matrices) {
+        double error = identityError(m, invert(m));
+        if (!std::isfinite(error)) error = INFINITY;
+        maxError = std::max(maxError, error);
+        sumError += error;
+    }
+    std::cout << "  " << std::left << std::setw(18) << family << std::setw(15) << method
+              << "mean " << std::setw(12) << sumError / matrices.size()
+              << "max " << maxError << std::endl;
+}
+
+template <typename T, typename Invert>
+double timeInverse(const std::vector<Mat4T<T>> &matrices, Invert invert) {
+    // Accumulate the results so that the inversions are not optimized away.
+    T sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < 10; ++pass) {
+        for (const Mat4T<T> &m : matrices) sum += invert(m)[0][3];
+    }
+    auto end = std::chrono::steady_clock::now();
+    asm volatile("" : : "g"(sum));
+    return std::chrono::duration<double, std::nano>(end - start).count() /
+           (10.0 * matrices.size());
+}
+
+template <typename T>
+void run(const char *name, int count) {
+    TransformGenerator<T> generator;
+    std::vector<Mat4T<T>> scale, rotationScale, arbitrary;
+    for (int i = 0; i < count; ++i) {
+        scale.push_back(generator.scale());
+        rotationScale.push_back(generator.rotationScale());
+        arbitrary.push_back(generator.arbitrary());
+    }
+
+    auto general = [](const Mat4T<T> &m) { return m.inverse(); };
+    auto decomposition = [](const Mat4T<T> &m) { return decompositionInverse(m); };
+
+    std::cout << name << ": max |M * inverse(M) - I| over " << count << " matrices"
+              << std::endl;
+    reportPrecision("scale", "general", scale, general);
+    reportPrecision("scale", "decomposition", scale, decomposition);
+    reportPrecision("rotation * scale", "general", rotationScale, general);
+    reportPrecision("rotation * scale", "decomposition", rotationScale, decomposition);
+    reportPrecision("arbitrary", "general", arbitrary, general);
+    reportPrecision("arbitrary", "decomposition", arbitrary, decomposition);
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "  time per inverse: general " << timeInverse(rotationScale, general)
+              << " ns, decomposition " << timeInverse(rotationScale, decomposition)
+              << " ns" << std::endl;
+    std::cout << std::defaultfloat << std::setprecision(6);
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    int count = argc > 1 ? std::atoi(argv[1]) : 100000;
+    run<double>("double", count);
+    run<float>("float", count);
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "lodepng.h"
+
+// Renders the demo scene with the double and float builds of the renderer and
+// reports how long each took and how far apart the two images are.
+//
+// Usage: bench_precision <raytracer> <raytracer_float> [samples]
+
+namespace {
+// Run a renderer and return the wall clock time it took in seconds.
+double timeRender(const std::string &exe, const std::string &path,
+                  const std::string &samples) {
+    std::string command = "\"" + exe + "\" " + path + " " + samples;
+    auto start = std::chrono::steady_clock::now();
+    int status = std::system(command.c_str());
+    auto end = std::chrono::steady_clock::now();
+    if (status != 0) {
+        std::cout << "Error: " << command << " exited with " << status << std::endl;
+        std::exit(1);
+    }
+    return std::chrono::duration<double>(end - start).count();
+}
+
+std::vector<unsigned char> decode(const std::string &path, unsigned &width,
+                                  unsigned &height) {
+    std::vector<unsigned char> pixels;
+    unsigned error = lodepng::decode(pixels, width, height, path);
+    if (error) {
+        std::cout << "Error " << error << ": " << lodepng_error_text(error)
+                  << std::endl;
+        std::exit(1);
+    }
+    return pixels;
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cout << "Usage: " << argv[0]
+                  << " <raytracer> <raytracer_float> [samples]" << std::endl;
+        return 1;
+    }
+    std::string samples = argc > 3 ? argv[3] : "4";
+
+    double doubleTime = timeRender(argv[1], "precision_double.png", samples);
+    double floatTime = timeRender(argv[2], "precision_float.png", samples);
+
+    unsigned width, height, floatWidth, floatHeight;
+    auto reference = decode("precision_double.png", width, height);
+    auto image = decode("precision_float.png", floatWidth, floatHeight);
+    if (width != floatWidth || height != floatHeight) {
+        std::cout << "Error: the images have different dimensions" << std::endl;
+        return 1;
+    }
+
+    // Compare the rgb channels. Alpha is always opaque.
+    double squaredError = 0;
+    int maxError = 0;
+    size_t differentPixels = 0;
+    for (size_t i = 0; i < reference.size(); i += 4) {
+        int pixelError = 0;
+        for (size_t c = 0; c < 3; ++c) {
+            int error = std::abs(reference[i + c] - image[i + c]);
+            squaredError += error * error;
+            pixelError = std::max(pixelError, error);
+        }
+        maxError = std::max(maxError, pixelError);
+        if (pixelError > 2) differentPixels++;
+    }
+    size_t pixels = static_cast<size_t>(width) * height;
+    double rmse = std::sqrt(squaredError / (3.0 * pixels));
+    double psnr = rmse > 0 ? 20 * std::log10(255.0 / rmse) : INFINITY;
+
+    std::cout << "double: " << doubleTime << " s" << std::endl;
+    std::cout << "float:  " << floatTime << " s (" << doubleTime / floatTime
+              << "x)" << std::endl;
+    std::cout << "rmse: " << rmse << ", psnr: " << psnr << " dB, max error: "
+              << maxError << ", pixels off by more than 2: "
+              << 100.0 * differentPixels / pixels << "%" << std::endl;
+    return 0;
+}
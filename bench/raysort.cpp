@@ -0,0 +1,102 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include "scene.h"
+
+// Renders a lattice of mirrored and glass spheres with the wavefront integrator,
+// with and without sorting the secondary rays, and reports the best of a few
+// runs of each. Sorting only changes the order in which rays are traced, so
+// the two images differ by rounding alone.
+//
+// Each chunk of rays skips the spheres that all of its rays point away from.
+// A sorted chunk starts in one part of the lattice and goes one way, so most
+// of the lattice is behind it. An unsorted chunk mixes rays from everywhere,
+// going every way, and has to test them all.
+//
+// Usage: bench_raysort [spheres per side] [image width] [samples]
+
+namespace {
+Scene sphereLattice(const Viewport &vp, int side) {
+    MaterialTable materials;
+    MaterialId metal = materials.add(Material::from(MaterialType::PolishedMetal, Color::grey()));
+    MaterialId glass = materials.add(Material::from(MaterialType::Glass, Color::white()));
+
+    std::vector<std::shared_ptr<Object>> objs;
+    Real spacing = Real(4) / side;
+    for (int i = 0; i < side; ++i) {
+        for (int j = 0; j < side; ++j) {
+            for (int k = 0; k < side; ++k) {
+                Pnt3 center{-2 + (k + Real(0.5)) * spacing, -2 + (j + Real(0.5)) * spacing,
+                            -2 - (i + Real(0.5)) * spacing};
+                MaterialId material = (i + j + k) % 3 == 0 ? glass : metal;
+                objs.push_back(std::make_shared<Object>(
+                        std::make_shared<Sphere>(center, spacing * Real(0.3)), material));
+            }
+        }
+    }
+
+    std::vector<std::shared_ptr<Light>> lights;
+    lights.push_back(std::make_shared<SquareLight>(10, Pnt3(0, 3.0, -1.0), Color(1, 1, 1),
+                                                   Vec3(0, -2, 2).normalize(), 1));
+
+    Camera cam(vp, Pnt3(0, 0, 2), 1);
+    return Scene(objs, materials, lights, cam);
+}
+
+// Render the scene and return the pixels and the time it took in seconds.
+std::pair<std::vector<Color>, double> render(Scene &scene, const Image &img,
+                                             const RenderSettings &settings) {
+    auto start = std::chrono::steady_clock::now();
+    scene.render("bench_raysort.png", settings);
+    auto end = std::chrono::steady_clock::now();
+
+    std::vector<Color> pixels;
+    pixels.reserve(static_cast<size_t>(img.getWidth()) * img.getHeight());
+    for (int row = 0; row < img.getHeight(); ++row) {
+        for (int col = 0; col < img.getWidth(); ++col) pixels.push_back(img.getPixel(row, col));
+    }
+    return {pixels, std::chrono::duration<double>(end - start).count()};
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    int side = argc > 1 ? std::atoi(argv[1]) : 8;
+    int width = argc > 2 ? std::atoi(argv[2]) : 160;
+    unsigned samples = argc > 3 ? std::atoi(argv[3]) : 2;
+    Viewport vp(2, width, 16.0 / 9.0);
+    Scene scene = sphereLattice(vp, side);
+    const Image &img = *vp.getImg();
+
+    RenderSettings settings(samples);
+    settings.integrator = WavefrontIntegrator;
+    double unsortedTime = INFINITY, sortedTime = INFINITY;
+    std::vector<Color> unsorted, sorted;
+    for (int run = 0; run < 3; ++run) {
+        settings.sortRays = false;
+        auto [pixels, time] = render(scene, img, settings);
+        unsorted = pixels;
+        unsortedTime = std::min(unsortedTime, time);
+
+        settings.sortRays = true;
+        std::tie(pixels, time) = render(scene, img, settings);
+        sorted = pixels;
+        sortedTime = std::min(sortedTime, time);
+    }
+
+    int differing = 0;
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        Color d = sorted[i] - unsorted[i];
+        differing += d.r != 0 || d.g != 0 || d.b != 0;
+    }
+
+    std::cout << side * side * side << " spheres, " << img.getWidth() << "x" << img.getHeight()
+              << " image, " << samples << " spp" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "  unsorted " << unsortedTime << " s, sorted " << sortedTime << " s"
+              << std::endl;
+    std::cout << "  " << differing << " pixels differ" << std::endl;
+    return 0;
+}
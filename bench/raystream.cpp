@@ -0,0 +1,96 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "scene.h"
+
+// Times Scene::castRays against casting the same rays one at a time with
+// Scene::castRay, and times the two halves of a stream cast on their own:
+// RayStream::transformed and Geometry::hit.
+//
+// The scene is a row of spheres in front of the camera, and the rays are
+// random directions through it, so about half of them hit something.
+//
+// Usage: bench_raystream [objects]
+
+namespace {
+constexpr long RAYS_PER_RUN = 2000000;
+
+template <typename F>
+double nsPerRay(long rays, F f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / rays;
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    int objects = argc > 1 ? std::atoi(argv[1]) : 6;
+
+    MaterialTable materials;
+    MaterialId matte = materials.add(Material::from(Matte, Color::white()));
+    std::vector<std::shared_ptr<Object>> objs;
+    for (int k = 0; k < objects; ++k) {
+        auto sphere = std::make_shared<Sphere>(Pnt3{Real(k) - objects / Real(2), 0, -5},
+                                               Real(0.7));
+        objs.push_back(std::make_shared<Object>(sphere, matte));
+    }
+    // The scene takes ownership of the objects.
+    std::shared_ptr<Geometry> first = objs[0]->geometry;
+    std::vector<std::shared_ptr<Light>> lights;
+    Viewport viewport(2, 16, 16.0 / 9);
+    Camera cam(viewport, Pnt3{0, 0, 0}, 1);
+    Scene scene(objs, materials, lights, cam);
+
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<Real> unit(-1, 1);
+
+    std::cout << objects << " objects, " << RAYS_PER_RUN << " rays per run" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    for (int n : {1, 4, 16, 64, 256, 1024, 4096}) {
+        std::vector<Ray> rays(n);
+        RayStream stream;
+        stream.resize(n);
+        for (int i = 0; i < n; ++i) {
+            rays[i] = Ray{Pnt3{0, 0, 0}, Vec3(unit(gen) * objects / 2, unit(gen), -5).normalize()};
+            stream.set(i, rays[i]);
+        }
+        long runs = RAYS_PER_RUN / n;
+        long total = runs * n;
+
+        // Count the hits so that the casts are not optimized away.
+        size_t hits = 0;
+        double scalar = nsPerRay(total, [&] {
+            for (long r = 0; r < runs; ++r) {
+                for (Ray &ray : rays) hits += scene.castRay(ray).has_value();
+            }
+        });
+        Arena arena;
+        double streamed = nsPerRay(total, [&] {
+            for (long r = 0; r < runs; ++r) {
+                for (const auto &hit : scene.castRays(stream, arena)) hits += hit.has_value();
+                arena.reset();
+            }
+        });
+
+        RayStream objSpace;
+        std::vector<Real> minusT(n), plusT(n);
+        const Geometry &geometry = *first;
+        double transform = nsPerRay(total, [&] {
+            for (long r = 0; r < runs; ++r) stream.transformed(geometry.inverse(), objSpace);
+        });
+        double intersect = nsPerRay(total, [&] {
+            for (long r = 0; r < runs; ++r) geometry.hit(objSpace, minusT.data(), plusT.data());
+        });
+        asm volatile("" : : "g"(objSpace.dx[0] + minusT[0]));
+
+        std::cout << "  stream of " << std::setw(4) << n << ": castRay " << scalar
+                  << " ns/ray, castRays " << streamed << " ns/ray, transform "
+                  << transform << " ns/ray/object, hit " << intersect
+                  << " ns/ray/object (" << hits << " hits)" << std::endl;
+    }
+    return 0;
+}
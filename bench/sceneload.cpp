@@ -0,0 +1,145 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <span>
+#include <vector>
+#include "scene.h"
+
+// Times building a scene of many spheres whose transforms come from a flat
+// buffer of numbers, as a scene loader would produce, and counts the heap
+// allocations made while doing it.
+//
+// "vector" builds each matrix the way the removed std::vector<std::vector>
+// constructor did, "list" uses the initializer-list constructor and "span"
+// the span constructor. The matrix-only rows build the matrices and nothing
+// else; the scene rows also create the spheres, their objects and the scene.
+//
+// Usage: bench_sceneload [objects]
+
+namespace {
+// Heap allocations made through operator new since the program started.
+unsigned long allocations = 0;
+}  // namespace
+
+void *operator new(std::size_t size) {
+    ++allocations;
+    if (void *p = std::malloc(size)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+// The constructor this benchmark compares against. The argument is taken by
+// value, so every call allocates the outer vector and each of the four rows.
+Mat4 vectorMatrix(const std::vector<std::vector<Real>> arr) {
+    Mat4 m;
+    for (int i = 0; i < Mat4::SIZE; ++i) {
+        for (int j = 0; j < Mat4::SIZE; ++j) {
+            m[i][j] = arr[i][j];
+        }
+    }
+    return m;
+}
+
+Mat4 fromVector(const Real *e) {
+    return vectorMatrix({{e[0], e[1], e[2], e[3]},
+                         {e[4], e[5], e[6], e[7]},
+                         {e[8], e[9], e[10], e[11]},
+                         {e[12], e[13], e[14], e[15]}});
+}
+
+Mat4 fromList(const Real *e) {
+    return Mat4{{e[0], e[1], e[2], e[3]},
+                {e[4], e[5], e[6], e[7]},
+                {e[8], e[9], e[10], e[11]},
+                {e[12], e[13], e[14], e[15]}};
+}
+
+Mat4 fromSpan(const Real *e) { return Mat4{std::span<const Real, 16>(e, 16)}; }
+
+struct Measurement {
+    double nsPerObject;
+    double allocationsPerObject;
+};
+
+template <typename F>
+Measurement measure(int count, F f) {
+    unsigned long before = allocations;
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return Measurement{std::chrono::duration<double, std::nano>(end - start).count() / count,
+                       double(allocations - before) / count};
+}
+
+// Build only the matrices, summing an element so that they are not optimized
+// away.
+template <typename Make>
+Measurement buildMatrices(const std::vector<Real> &elements, int count, Make make) {
+    return measure(count, [&] {
+        Real sum = 0;
+        for (int k = 0; k < count; ++k) sum += make(&elements[16 * k])[0][3];
+        asm volatile("" : : "g"(sum));
+    });
+}
+
+// Build a scene with one sphere per matrix.
+template <typename Make>
+Measurement buildScene(const std::vector<Real> &elements, int count, Make make) {
+    return measure(count, [&] {
+        MaterialTable materials;
+        MaterialId material = materials.add(Material::from(Matte, Color::white()));
+        std::vector<std::shared_ptr<Object>> objs;
+        objs.reserve(count);
+        for (int k = 0; k < count; ++k) {
+            auto sphere = std::make_shared<Sphere>();
+            sphere->setCoordSystem(make(&elements[16 * k]));
+            objs.push_back(std::make_shared<Object>(sphere, material));
+        }
+        std::vector<std::shared_ptr<Light>> lights;
+        Viewport viewport(2, 16, 16.0 / 9);
+        Camera cam(viewport, Pnt3{0, 0, 0}, 1);
+        Scene scene(objs, materials, lights, cam);
+    });
+}
+
+void report(const char *name, Measurement m) {
+    std::cout << "  " << std::left << std::setw(20) << name << std::right << std::setw(8)
+              << m.nsPerObject << " ns/object " << std::setw(6) << m.allocationsPerObject
+              << " allocations/object" << std::endl;
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    int count = argc > 1 ? std::atoi(argv[1]) : 1000000;
+
+    // Random scale-and-translate transforms laid out as 16 row-major elements
+    // each.
+    std::mt19937_64 gen(7);
+    std::uniform_real_distribution<Real> scale(0.1, 2), offset(-100, 100);
+    std::vector<Real> elements(16 * std::size_t(count));
+    for (int k = 0; k < count; ++k) {
+        Real *e = &elements[16 * k];
+        e[0] = e[5] = e[10] = scale(gen);
+        e[3] = offset(gen);
+        e[7] = offset(gen);
+        e[11] = offset(gen);
+        e[15] = 1;
+    }
+
+    std::cout << count << " objects" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    report("vector matrix", buildMatrices(elements, count, fromVector));
+    report("list matrix", buildMatrices(elements, count, fromList));
+    report("span matrix", buildMatrices(elements, count, fromSpan));
+    report("vector scene", buildScene(elements, count, fromVector));
+    report("list scene", buildScene(elements, count, fromList));
+    report("span scene", buildScene(elements, count, fromSpan));
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "scene.h"
+
+// Times Scene::castRay per ray and object as the scene grows past the caches.
+//
+// The objects are created the way a loader that interleaves other allocations
+// would create them: in a random order, with unrelated blocks allocated
+// between them. A scene that kept pointers to them would jump around the heap
+// for every object; the scene copies them into contiguous arrays, so the cost
+// per object should only rise as far as streaming those arrays from memory
+// costs.
+//
+// Usage: bench_scenesize [rays]
+//
+// rays is the number of rays cast into the largest scenes.
+
+int main(int argc, char **argv) {
+    int rays = argc > 1 ? std::atoi(argv[1]) : 100;
+
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<Real> unit(-1, 1);
+
+    std::cout << std::fixed << std::setprecision(2);
+    for (int objects : {1000, 10000, 100000, 1000000}) {
+        MaterialTable materials;
+        MaterialId matte = materials.add(Material::from(Matte, Color::white()));
+
+        std::vector<std::shared_ptr<Object>> objs;
+        std::vector<std::unique_ptr<char[]>> clutter;
+        for (int k = 0; k < objects; ++k) {
+            clutter.emplace_back(new char[64 + gen() % 512]);
+            Pnt3 center{unit(gen) * 50, unit(gen) * 50, -60 + unit(gen) * 10};
+            objs.push_back(std::make_shared<Object>(std::make_shared<Sphere>(center, Real(0.3)),
+                                                    matte));
+        }
+        std::shuffle(objs.begin(), objs.end(), gen);
+
+        std::vector<std::shared_ptr<Light>> lights;
+        Viewport viewport(2, 16, 16.0 / 9);
+        Camera cam(viewport, Pnt3{0, 0, 0}, 1);
+        Scene scene(objs, materials, lights, cam);
+
+        // Small scenes get more rays so that every row takes long enough to time.
+        int count = std::max(rays, 50000000 / objects);
+        std::vector<Ray> cast;
+        for (int i = 0; i < count; ++i) {
+            cast.push_back(Ray{Pnt3{0, 0, 0}, Vec3(unit(gen), unit(gen), -1).normalize()});
+        }
+
+        // Count the hits so that the casts are not optimized away.
+        size_t hits = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (Ray &ray : cast) hits += scene.castRay(ray).has_value();
+        auto end = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(end - start).count();
+
+        std::cout << "  " << std::setw(8) << objects << " objects: " << ns / count / objects
+                  << " ns/ray/object (" << hits << " hits)" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include "scene.h"
+
+// Renders the demo scene with the recursive and the wavefront integrator and
+// compares their speed and output. The two consume their samples in different
+// orders, so their images differ by noise. To tell noise from bias, the
+// difference between them is printed next to the difference between two
+// recursive renders with different seeds.
+//
+// Usage: bench_wavefront [image width] [samples]
+
+namespace {
+// Build the scene from src/main.cpp with the given viewport.
+Scene demoScene(const Viewport &vp) {
+    MaterialTable materials;
+    MaterialId m1 = materials.add(Material::from(MaterialType::Glass, Color::grey()));
+    MaterialId m2 = materials.add(Material::from(MaterialType::PolishedMetal, Color::grey()));
+    MaterialId m3 = materials.add(Material::from(MaterialType::Plastic, Color::white()));
+    MaterialId m4 = materials.add(Material::from(MaterialType::Plastic, Color(0.9803, 0.501, 0.447)));
+    MaterialId m5 = materials.add(Material::from(MaterialType::Plastic, Color(0.341, 0.463, 0.831)));
+
+    std::vector<std::shared_ptr<Object>> objs{
+        std::make_shared<Object>(std::make_shared<Sphere>(Pnt3(1.0, -0.7, -1.0), 0.7), m1),
+        std::make_shared<Object>(std::make_shared<Sphere>(Pnt3(-1.0, -0.4, -2.5), 0.9), m2),
+        std::make_shared<Object>(std::make_shared<Sphere>(Pnt3(0, -500.5, -30), 500), m3),
+        std::make_shared<Object>(std::make_shared<Sphere>(Pnt3(-501.5, 0, 40), 500), m4),
+        std::make_shared<Object>(std::make_shared<Sphere>(Pnt3(501.5, 0, 40), 500), m5),
+        std::make_shared<Object>(std::make_shared<Sphere>(Pnt3(0, 0, -505.5), 500), m3),
+    };
+
+    std::vector<std::shared_ptr<Light>> lights;
+    lights.push_back(std::make_shared<SquareLight>(10, Pnt3(0, 2.0, -1.0), Color(1, 1, 1),
+                                                   Vec3(0, -2, 2).normalize(), 1));
+
+    Camera cam(vp, Pnt3(0, 0, 3), 1);
+    return Scene(objs, materials, lights, cam);
+}
+
+// Render the scene and return the pixels and the time it took in seconds.
+std::pair<std::vector<Color>, double> render(Scene &scene, const Image &img,
+                                             const RenderSettings &settings) {
+    auto start = std::chrono::steady_clock::now();
+    scene.render("bench_wavefront.png", settings);
+    auto end = std::chrono::steady_clock::now();
+
+    std::vector<Color> pixels;
+    pixels.reserve(static_cast<size_t>(img.getWidth()) * img.getHeight());
+    for (int row = 0; row < img.getHeight(); ++row) {
+        for (int col = 0; col < img.getWidth(); ++col) pixels.push_back(img.getPixel(row, col));
+    }
+    return {pixels, std::chrono::duration<double>(end - start).count()};
+}
+
+// Root mean square difference of two images over all channels.
+double rmse(const std::vector<Color> &a, const std::vector<Color> &b) {
+    double sum = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        Color d = a[i] - b[i];
+        sum += d.r * d.r + d.g * d.g + d.b * d.b;
+    }
+    return std::sqrt(sum / (3 * a.size()));
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    int width = argc > 1 ? std::atoi(argv[1]) : 320;
+    unsigned samples = argc > 2 ? std::atoi(argv[2]) : 4;
+    Viewport vp(2, width, 16.0 / 9.0);
+    Scene scene = demoScene(vp);
+    const Image &img = *vp.getImg();
+
+    RenderSettings settings(samples);
+    auto [recursive, recursiveTime] = render(scene, img, settings);
+    settings.integrator = WavefrontIntegrator;
+    auto [wavefront, wavefrontTime] = render(scene, img, settings);
+    settings.integrator = RecursiveIntegrator;
+    settings.seed = 1;
+    auto [reseeded, reseededTime] = render(scene, img, settings);
+
+    std::cout << img.getWidth() << "x" << img.getHeight() << " image, " << samples << " spp"
+              << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "  recursive " << recursiveTime << " s, wavefront " << wavefrontTime << " s"
+              << std::endl;
+    std::cout << std::setprecision(5);
+    std::cout << "  rmse wavefront vs recursive " << rmse(recursive, wavefront)
+              << ", recursive vs recursive with another seed " << rmse(recursive, reseeded)
+              << std::endl;
+    return 0;
+}
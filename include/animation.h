@@ -0,0 +1,63 @@
+#pragma once
+#include <string>
+#include <utility>
+#include <vector>
+#include "scene.h"
+
+// Where the camera is and what it looks at, at a time in seconds. See the
+// look-at Camera constructor for the meaning of each field.
+struct CameraKey {
+    double time;
+    Pnt3 from, to;
+    Vec3 up{0, 1, 0};
+    Real fov = 60;
+    Real aperture = 0;
+    Real focusDistance = 0;
+};
+
+// Where an object is at a time in seconds: its object space origin is moved
+// to the position and it is scaled uniformly, like Sphere(center, radius).
+struct ObjectKey {
+    double time;
+    Pnt3 position;
+    Real scale = 1;
+};
+
+// The time it took to render one frame of a sequence.
+struct FrameTiming {
+    // Moving the camera and objects and refitting the scene.
+    double setup;
+
+    // Tracing the frame. Encoding overlaps the next frame, so it isn't
+    // counted here.
+    double trace;
+};
+
+// Camera and object keyframes, rendered as a sequence of frames in one run.
+// The scene is built once: every frame moves the camera, refits the objects
+// that move in place, and traces while the previous frame is encoded on a
+// background thread. Values between keys are interpolated linearly and held
+// before the first key and after the last.
+class Animation {
+private:
+    std::vector<CameraKey> cameraKeys;
+    std::vector<std::pair<PrimitiveHandle, std::vector<ObjectKey>>> objectTracks;
+
+    // Return the camera of the scene at a time.
+    Camera cameraAt(const Viewport &viewport, double time) const;
+
+public:
+    // Add a camera key. Keys can be added in any order.
+    void addCameraKey(const CameraKey &key);
+
+    // Add a key for an object of the scene. Keys can be added in any order.
+    void addObjectKey(PrimitiveHandle object, const ObjectKey &key);
+
+    // Render frames 0 to frames - 1, frame i at time i / fps, and save them at
+    // the pattern with its first run of '#' replaced by the zero padded frame
+    // number, such as "frame####.png". Prints the time each frame took and
+    // returns them. The scene is left at the last frame. A timeline in the
+    // settings covers the whole sequence.
+    std::vector<FrameTiming> render(Scene &scene, const std::string &pattern, int frames,
+                                    double fps, const RenderSettings &settings) const;
+};
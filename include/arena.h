@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// A bump allocator for memory that is only needed for a short while, such as
+// the scratch buffers used to render one tile. Allocating moves a pointer
+// forward inside a block. Nothing is freed on its own; reset makes all of the
+// memory available again but keeps the blocks, so once an arena has grown to
+// what a tile needs, later tiles do not touch the heap.
+//
+// Only trivially destructible objects may live in an arena, since resetting it
+// does not run destructors.
+class Arena {
+private:
+    struct Block {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+
+    // Blocks are kept in the order they were created and filled front to back.
+    std::vector<Block> blocks;
+
+    // The block that is being allocated from and the first free byte in it.
+    size_t current = 0;
+    size_t offset = 0;
+
+    // The size of a new block, unless a single allocation needs more.
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+public:
+    Arena() = default;
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    // Return size bytes of uninitialized memory aligned to align, which must be
+    // a power of two.
+    void *allocate(size_t size, size_t align);
+
+    // Return an array of n value-initialized objects.
+    template <typename T>
+    std::span<T> allocateArray(size_t n) {
+        static_assert(std::is_trivially_destructible_v<T>,
+                      "arena memory is released without running destructors");
+        T *p = static_cast<T *>(allocate(n * sizeof(T), alignof(T)));
+        std::uninitialized_value_construct_n(p, n);
+        return std::span<T>(p, n);
+    }
+
+    // Release everything that was allocated, keeping the blocks for reuse.
+    void reset() {
+        current = 0;
+        offset = 0;
+    }
+
+    // Return the total size of the blocks owned by the arena, in bytes.
+    size_t capacity() const;
+
+    // Return the arena of the calling thread. The renderer resets it before
+    // each tile.
+    static Arena &local();
+};
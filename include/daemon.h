@@ -0,0 +1,41 @@
+#pragma once
+#include <map>
+#include <string>
+#include "scene.h"
+
+// Keeps scenes loaded between renders and renders them on request, so a
+// turntable or parameter sweep pays for process startup and building the
+// scenes once instead of once per frame.
+//
+// Clients connect to the address the daemon listens on (see distributed.h)
+// and send one request per line. Each request gets a one line reply that
+// starts with "ok" or "error". Requests are handled one at a time, in order.
+//
+//   render <scene> <output.png> [key=value ...]
+//       Render a scene and save it. Replies "ok <seconds>" once the image is
+//       saved, or an error if it could not be rendered or saved. The keys
+//       are samples, seed, integrator (recursive or wavefront), crop
+//       (x0,y0,x1,y1) and the camera: from and to (x,y,z, both needed to
+//       move the camera), up (x,y,z, default 0,1,0), fov (vertical, in
+//       degrees, default 60), aperture and focus. Requests without from and
+//       to use the scene's own camera.
+//   list
+//       Reply with the names of the scenes.
+//   shutdown
+//       Reply, then stop serving.
+class RenderDaemon {
+private:
+    std::map<std::string, Scene *> scenes;
+
+    // Handle a request and return the reply. Sets stop for a shutdown.
+    std::string handle(const std::string &request, bool &stop);
+
+public:
+    // Make a scene available to requests under a name. The scene must outlive
+    // the daemon.
+    void add(const std::string &name, Scene &scene);
+
+    // Listen on the address and serve requests until a client asks the daemon
+    // to shut down. Returns false if the address could not be listened on.
+    bool serve(const std::string &address);
+};
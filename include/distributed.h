@@ -0,0 +1,69 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+// Sockets that carry tiles between a coordinator process and the worker
+// processes that trace them. See Scene::renderDistributed.
+//
+// Addresses are either "unix:<path>" for a Unix domain socket on one host or
+// "tcp:<host>:<port>" for TCP, where an empty host listens on every interface.
+// Messages are sent in the byte order and layout of the machine, so every
+// process of a render must run the same build on the same architecture.
+namespace distributed {
+
+// Identifies the raytracer's tile protocol. Bump the version whenever a
+// message changes.
+inline constexpr char MAGIC[4] = {'R', 'T', 'W', 'K'};
+inline constexpr uint32_t VERSION = 1;
+
+// The first message a worker sends, which lets the coordinator turn away
+// workers that built a different scene.
+struct Hello {
+    char magic[4];
+    uint32_t version;
+    int32_t width, height;
+    uint32_t primitives, lights;
+};
+
+// The settings a worker traces its tiles with, sent once after the hello.
+struct JobSettings {
+    uint32_t samples;
+    uint32_t sampler;
+    uint32_t seed;
+    uint32_t integrator;
+    uint32_t sortRays;
+};
+
+// Listen on the address and return the socket, or -1 after printing an error.
+// A stale Unix socket file at the path is replaced.
+int listen(const std::string &address);
+
+// Connect to the address and return the socket, or -1 after printing an error.
+// Keeps retrying for timeout seconds so that workers can be started before
+// the coordinator.
+int connect(const std::string &address, double timeout = 30);
+
+// Wait up to timeout seconds for a connection on a listening socket. Returns
+// the new socket, or -1 if none arrived.
+int accept(int listener, double timeout);
+
+// Stop listening, removing the socket file of a Unix address.
+void close(int listener, const std::string &address);
+
+// Send or receive exactly size bytes. Return false if the connection failed
+// or was closed first.
+bool sendAll(int socket, const void *data, size_t size);
+bool receiveAll(int socket, void *data, size_t size);
+
+// Start count copies of the executable as `<executable> --worker <address>`
+// and return their process IDs. The executable is looked up on the PATH like
+// a shell would.
+std::vector<pid_t> spawnWorkers(const std::string &executable, const std::string &address,
+                                int count);
+
+// Wait for spawned workers to exit.
+void waitForWorkers(const std::vector<pid_t> &workers);
+}  // namespace distributed
@@ -0,0 +1,106 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "light.h"
+
+class Image;
+
+// A rectangle of pixels [x0, x1) x [y0, y1). Rows are counted from the top of
+// the image.
+struct Tile {
+    int x0, y0, x1, y1;
+};
+
+// Identifies the render that a checkpoint belongs to and how far it got. The
+// samples are a pure function of the sampler settings and the sample counts
+// stored on the film, so this is all that is needed to resume the render.
+struct CheckpointInfo {
+    uint32_t sampler;
+    uint32_t seed;
+    uint32_t samples;
+    uint32_t pass;
+};
+
+// Accumulates the samples taken for every pixel of an image. Alongside the sum
+// of the samples, the film keeps a running mean and variance of each pixel's
+// luminance so that the renderer can tell which pixels have converged.
+class Film {
+private:
+    struct Pixel {
+        Color sum{0, 0, 0};
+        Real mean = 0;
+        Real m2 = 0;
+        unsigned count = 0;
+    };
+
+    int width, height;
+    // The column and row of the image that the film's first pixel covers.
+    int left, top;
+    std::vector<Pixel> pixels;
+
+    // What each pixel cost to render, in whatever unit the renderer measures.
+    // Not part of checkpoints.
+    std::vector<double> costs;
+
+public:
+    // Create an empty film with the given dimensions.
+    Film(int width, int height);
+
+    // Create an empty film that covers a window of a larger image. Rows and
+    // columns passed to the film count from the corner of the window.
+    explicit Film(const Tile &window);
+
+    // Add a sample to the pixel at the specified row and col.
+    void addSample(int row, int col, const Color &color);
+
+    // Return the number of samples taken for a pixel.
+    unsigned count(int row, int col) const;
+
+    // Return the current estimate of a pixel. That is, the mean of its samples.
+    Color estimate(int row, int col) const;
+
+    // Return the standard error of a pixel's mean luminance relative to the
+    // luminance itself. The luminance is floored so that nearly black pixels
+    // are not sampled forever.
+    Real relativeError(int row, int col) const;
+
+    // Write the current estimate of every pixel into an image, with the first
+    // pixel of the film at the given column and row.
+    void resolve(Image &img, int x = 0, int y = 0) const;
+
+    // Add to the cost of rendering a pixel.
+    void addCost(int row, int col, double cost) { costs[row * width + col] += cost; }
+
+    // Return the cost of rendering a pixel so far.
+    double cost(int row, int col) const { return costs[row * width + col]; }
+
+    // Write the cost of every pixel into an image as a heatmap that goes from
+    // black through purple and orange to pale yellow. The scale tops out at
+    // the 99th percentile, so a few outliers don't wash out the rest.
+    void resolveCost(Image &img) const;
+
+    // Save the film to a compact binary checkpoint file. The file is written to
+    // a temporary path first and then renamed, so an interrupted save never
+    // leaves a corrupt checkpoint behind.
+    bool save(const std::string &path, const CheckpointInfo &info) const;
+
+    // Restore the film from a checkpoint file. Fails if the file doesn't exist,
+    // is corrupt or was saved from a film with different dimensions, window or
+    // precision.
+    bool load(const std::string &path, CheckpointInfo &info);
+
+    // Split the film into tiles of at most size x size pixels.
+    std::vector<Tile> tiles(int size) const;
+
+    // Return the width of the film.
+    int getWidth() const { return width; }
+
+    // Return the height of the film.
+    int getHeight() const { return height; }
+
+    // Return the column of the image that the film starts at.
+    int getLeft() const { return left; }
+
+    // Return the row of the image that the film starts at.
+    int getTop() const { return top; }
+};
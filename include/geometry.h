@@ -1,33 +1,88 @@
 #pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <initializer_list>
 #include <iostream>
+#include <span>
 #include <sstream>
 #include <string>
 #include <vector>
-
-// Represents a motion or displacement in 3D space.
-struct Vec3 {
-    double x, y, z;     // vector components
+#include "simd.h"
+
+// The scalar type used throughout the renderer. Define RAYTRACER_FLOAT to
+// build the whole pipeline in single precision.
+#ifdef RAYTRACER_FLOAT
+using Real = float;
+#else
+using Real = double;
+#endif
+
+// Represents a motion or displacement in 3D space. With RAYTRACER_SIMD the
+// components are padded to four lanes and arithmetic runs on a single SIMD
+// register.
+template <typename T>
+struct alignas(simd::ALIGNMENT<T>) Vec3T {
+    using Vec3 = Vec3T<T>;
+    using Pack = simd::Pack4<T>;
+
+    T x, y, z;     // vector components
+#ifdef RAYTRACER_SIMD
+    T w = 0;       // padding lane, always zero
+#endif
 
     // Default contructor creates the zero vector. 
-    Vec3() : x(0), y(0), z(0){};    
+    constexpr Vec3T() : x(0), y(0), z(0) {}
 
     // 
-    Vec3(double x, double y, double z) : x(x), y(y), z(z) {}
+    constexpr Vec3T(T x, T y, T z) : x(x), y(y), z(z) {}
+
+    // Create a vector from a pack. The last lane of packs computed from vectors
+    // is already zero, so it is stored as is.
+    static Vec3 fromPack(Pack p) {
+        if constexpr (simd::ENABLED) {
+            Vec3 v;
+            p.store(&v.x);
+            return v;
+        }
+        T lanes[4];
+        p.store(lanes);
+        return Vec3{lanes[0], lanes[1], lanes[2]};
+    }
+
+    // Load the components into a pack. Without RAYTRACER_SIMD the vector has no
+    // padding lane, so the components are copied and the last lane is zero.
+    Pack pack() const {
+        if constexpr (simd::ENABLED) return Pack::load(&x);
+        const T lanes[4] = {x, y, z, 0};
+        return Pack::load(lanes);
+    }
 
     // Vector addition and substraction.
-    Vec3 operator+(const Vec3 &other) const;
-    Vec3 operator-(const Vec3 &other) const;
-    void operator+=(const Vec3 &other);
+    constexpr Vec3 operator+(const Vec3 &other) const {
+        if constexpr (simd::ENABLED) return fromPack(pack() + other.pack());
+        return Vec3(x + other.x, y + other.y, z + other.z);
+    }
+    constexpr Vec3 operator-(const Vec3 &other) const {
+        if constexpr (simd::ENABLED) return fromPack(pack() - other.pack());
+        return Vec3(x - other.x, y - other.y, z - other.z);
+    }
+    constexpr void operator+=(const Vec3 &other) { *this = *this + other; }
 
     // Scalar multiplication
-    Vec3 operator*(const double scalar) const;
-    Vec3 operator/(const double scalar) const;
-    Vec3 operator-() const;
-    void operator/=(const double scalar);
-
-    // Send a formatted string version of the vector to an ostream. Vectors are
-    // denoted by square brackets [].
-    friend std::ostream &operator<<(std::ostream &os, const Vec3 &v);
+    constexpr Vec3 operator*(const T scalar) const {
+        if constexpr (simd::ENABLED) return fromPack(pack() * Pack::broadcast(scalar));
+        return Vec3(scalar * x, scalar * y, scalar * z);
+    }
+    constexpr Vec3 operator/(const T scalar) const {
+        if constexpr (simd::ENABLED) return fromPack(pack() / Pack::broadcast(scalar));
+        return Vec3(x / scalar, y / scalar, z / scalar);
+    }
+    constexpr Vec3 operator-() const {
+        if constexpr (simd::ENABLED) return fromPack(Pack::broadcast(0) - pack());
+        return Vec3(-x, -y, -z);
+    }
+    constexpr void operator/=(const T scalar) { *this = *this / scalar; }
 
     // Return a string representation of the vector.
     std::string toString() const {
@@ -40,41 +95,76 @@ struct Vec3 {
     }
 
     // Take the reciprocal of all of the elements in the vector.
-    void reciprocal();
+    constexpr void reciprocal() {
+        x = 1 / x;
+        y = 1 / y;
+        z = 1 / z;
+    }
 
     // Negate all of the components of this vector.
-    void negate();
+    constexpr void negate() {
+        x = -x;
+        y = -y;
+        z = -z;
+    }
 
-    // Return the dot product of this vector and another one.
-    double dot(const Vec3 &other) const;
+    // Return the dot product of this vector and another one. This stays scalar
+    // even with RAYTRACER_SIMD, since the horizontal sum of a pack costs more
+    // than the two additions it saves.
+    constexpr T dot(const Vec3 &other) const {
+        return x * other.x + y * other.y + z * other.z;
+    }
 
     // Return the length of the vector.
-    double length() const;
+    T length() const { return std::sqrt(dot(*this)); }
 
     // Return a unit vector in the direction of this vector.
-    Vec3 normalize() const;
+    Vec3 normalize() const { return *this * (1 / length()); }
 
     // Check if the vector is the zero vector.
-    bool isZero() const;
+    constexpr bool isZero() const { return x == 0 && y == 0 && z == 0; }
 
     // Compute the dot product of two vectors.
-    static double dot(const Vec3 &first, const Vec3 &second);
+    static constexpr T dot(const Vec3 &first, const Vec3 &second) {
+        return first.dot(second);
+    }
 
     // Compute the cross product of two vectors.
-    static Vec3 cross(const Vec3 &first, const Vec3 &second);
+    static constexpr Vec3 cross(const Vec3 &first, const Vec3 &second) {
+        return Vec3(first.y * second.z - first.z * second.y,
+                    first.z * second.x - first.x * second.z,
+                    first.x * second.y - first.y * second.x);
+    }
 
     // Reflect the ray across a normal vector. Both of these vectors should be
     // unit vectors.
-    static Vec3 reflect(const Vec3 &incident, const Vec3 &normal);
+    static constexpr Vec3 reflect(const Vec3 &incident, const Vec3 &normal) {
+        return incident - normal * (2 * dot(incident, normal));
+    }
 
     // Refract a vector across a normal vector. The parameters kin and kout
     // describe the index of refraction of the inside and outside mediums
     // respectively. All vectors should be normalized and in world space.
-    static Vec3 refract(Vec3 &incident, Vec3 &normal, const double ki,
-                                            const double kt);
+    static Vec3 refract(Vec3 &incident, Vec3 &normal, const T ki,
+                                            const T kt) {
+        T cosTheta = dot(incident, normal);
+        T ratio = ki / kt;
+        if (cosTheta < 0) {
+            cosTheta = -cosTheta;
+        } else {
+            ratio = kt / ki;
+            normal = -normal;
+        }
+
+        T discriminant = 1 - ratio * ratio * (1 - cosTheta * cosTheta);
+        if (discriminant < 0) {
+            return reflect(incident, normal);
+        }
+        return (incident - normal * cosTheta) * ratio - normal * std::sqrt(discriminant);
+    }
 
     // Generate a random vector with components in a given range.
-    static Vec3 random(double min, double max);
+    static Vec3 random(T min, T max);
 
     // Generate a random vector with components in the range 0 - 1.
     static Vec3 random();
@@ -82,27 +172,90 @@ struct Vec3 {
     // Generate a random vector in the unit sphere.
     static Vec3 randomUnitVector();
 
+    // Map a point in the unit square to a unit vector. Uniformly distributed
+    // points map to uniformly distributed directions.
+    static Vec3 unitSphere(T u, T v) {
+        T z = 1 - 2 * u;
+        T r = std::sqrt(std::max(T(0), 1 - z * z));
+        T phi = T(2 * M_PI) * v;
+        return Vec3(r * std::cos(phi), r * std::sin(phi), z);
+    }
+
+    // Map a point in the unit square to a point in the unit disk in the xy
+    // plane, keeping uniformly distributed points uniform. Uses the concentric
+    // mapping, which keeps nearby points nearby.
+    static Vec3 unitDisk(T u, T v) {
+        T a = 2 * u - 1;
+        T b = 2 * v - 1;
+        if (a == 0 && b == 0) return zero();
+        T r, phi;
+        if (std::abs(a) > std::abs(b)) {
+            r = a;
+            phi = T(M_PI / 4) * (b / a);
+        } else {
+            r = b;
+            phi = T(M_PI / 2) - T(M_PI / 4) * (a / b);
+        }
+        return Vec3(r * std::cos(phi), r * std::sin(phi), 0);
+    }
+
     // Return the zero vector.
-    static Vec3 zero();
+    static constexpr Vec3 zero() { return Vec3(0, 0, 0); }
 };
 
-// Represents a location in 3D space.
-struct Pnt3 {
+// Represents a location in 3D space. Padded like Vec3T with RAYTRACER_SIMD, in
+// which case the fourth lane is one so that it picks up the translation of a
+// Mat4T.
+template <typename T>
+struct alignas(simd::ALIGNMENT<T>) Pnt3T {
+    using Vec3 = Vec3T<T>;
+    using Pnt3 = Pnt3T<T>;
+    using Pack = simd::Pack4<T>;
+
     // Coordinates in world-space.
-    double x, y, z;
+    T x, y, z;
+#ifdef RAYTRACER_SIMD
+    // Homogeneous coordinate, always one.
+    T w = 1;
+#endif
+
+    // Create a point from a pack. The last lane of packs computed from points
+    // is already one, so it is stored as is.
+    static Pnt3 fromPack(Pack p) {
+        if constexpr (simd::ENABLED) {
+            Pnt3 q;
+            p.store(&q.x);
+            return q;
+        }
+        T lanes[4];
+        p.store(lanes);
+        return Pnt3{lanes[0], lanes[1], lanes[2]};
+    }
+
+    // Load the coordinates into a pack. Without RAYTRACER_SIMD the point has no
+    // homogeneous coordinate, so the coordinates are copied and the last lane
+    // is one.
+    Pack pack() const {
+        if constexpr (simd::ENABLED) return Pack::load(&x);
+        const T lanes[4] = {x, y, z, 1};
+        return Pack::load(lanes);
+    }
 
     // Translate this point using a vector. Creates a new point and returns it.
-    Pnt3 operator+(const Vec3 &other) const;
+    constexpr Pnt3 operator+(const Vec3 &other) const {
+        if constexpr (simd::ENABLED) return fromPack(pack() + other.pack());
+        return Pnt3{x + other.x, y + other.y, z + other.z};
+    }
 
     // Translate this point using a vector.
-    void operator+=(const Vec3 &other);
+    constexpr void operator+=(const Vec3 &other) { *this = *this + other; }
 
     // Subtract two points and get a vector that represents the displacement
     // between them. Creates a new point and returns it.
-    Vec3 operator-(const Pnt3 &other) const;
-
-    // Display this point on an output stream.
-    friend std::ostream &operator<<(std::ostream &os, const Pnt3 &p);
+    constexpr Vec3 operator-(const Pnt3 &other) const {
+        if constexpr (simd::ENABLED) return Vec3::fromPack(pack() - other.pack());
+        return Vec3(x - other.x, y - other.y, z - other.z);
+    }
 
     // Convert this point to a string.
     std::string toString() const {
@@ -116,136 +269,502 @@ struct Pnt3 {
 };
 
 // A 3x3 matrix. Used for linear transformations.
-class Mat3 {
- private:
+template <typename T>
+class Mat3T {
+    using Vec3 = Vec3T<T>;
+    using Mat3 = Mat3T<T>;
+
+ public:
     static const int SIZE = 3;
 
+ private:
     // Internal representation of the matrix.
-    double data[SIZE][SIZE];
+    T data[SIZE][SIZE];
 
  public:
     // Create a 3x3 identity matrix and return it.
-    static Mat3 identity();
+    static constexpr Mat3 identity() {
+        Mat3 m{};
+        m[0][0] = 1;
+        m[1][1] = 1;
+        m[2][2] = 1;
+        return m;
+    }
 
     // Overload the [] operator to get an element from the matrix using an index.
-    double *operator[](int row);
+    constexpr T *operator[](int row) { return data[row]; }
 
     // Constant version of the [] operator overload.
-    const double *operator[](int row) const;
+    constexpr const T *operator[](int row) const { return data[row]; }
 
     // Matrix-vector multiplication.
-    Vec3 operator*(const Vec3 &v) const;
+    constexpr Vec3 operator*(const Vec3 &v) const {
+        return Vec3(data[0][0] * v.x + data[0][1] * v.y + data[0][2] * v.z,
+                    data[1][0] * v.x + data[1][1] * v.y + data[1][2] * v.z,
+                    data[2][0] * v.x + data[2][1] * v.y + data[2][2] * v.z);
+    }
 
     // Matrix-matrix multiplication.
-    Mat3 operator*(const Mat3 &m) const;
+    constexpr Mat3 operator*(const Mat3 &m) const {
+        Mat3 res{};
+        for (int i = 0; i < SIZE; ++i) {
+            for (int j = 0; j < SIZE; ++j) {
+                for (int k = 0; k < SIZE; ++k) {
+                    res[i][j] += data[i][k] * m[k][j];
+                }
+            }
+        }
+        return res;
+    }
 
     // Transpose the matrix. Transposing a matrix swaps the rows and columns.
-    void transpose();
+    constexpr void transpose() {
+        for (int i = 0; i < SIZE; ++i) {
+            for (int j = i + 1; j < SIZE; ++j) {
+                std::swap(data[i][j], data[j][i]);
+            }
+        }
+    }
 
     // Set the elements along the diagonal of the matrix to their reciprocals.
     // This method is most often used to invert a scaling matrix.
-    void setReciprocalDiag();
+    constexpr void setReciprocalDiag() {
+        data[0][0] = 1 / data[0][0];
+        data[1][1] = 1 / data[1][1];
+        data[2][2] = 1 / data[2][2];
+    }
+
+    // Return the determinant of the matrix.
+    constexpr T determinant() const {
+        return data[0][0] * (data[1][1] * data[2][2] - data[1][2] * data[2][1]) -
+               data[0][1] * (data[1][0] * data[2][2] - data[1][2] * data[2][0]) +
+               data[0][2] * (data[1][0] * data[2][1] - data[1][1] * data[2][0]);
+    }
+
+    // Compute the inverse of this matrix and return it. The inverse is the
+    // adjugate (the transposed matrix of cofactors) divided by the determinant.
+    // Singular matrices produce infinities.
+    constexpr Mat3 inverse() const {
+        Mat3 m{};
+        m[0][0] = data[1][1] * data[2][2] - data[1][2] * data[2][1];
+        m[0][1] = data[0][2] * data[2][1] - data[0][1] * data[2][2];
+        m[0][2] = data[0][1] * data[1][2] - data[0][2] * data[1][1];
+        m[1][0] = data[1][2] * data[2][0] - data[1][0] * data[2][2];
+        m[1][1] = data[0][0] * data[2][2] - data[0][2] * data[2][0];
+        m[1][2] = data[0][2] * data[1][0] - data[0][0] * data[1][2];
+        m[2][0] = data[1][0] * data[2][1] - data[1][1] * data[2][0];
+        m[2][1] = data[0][1] * data[2][0] - data[0][0] * data[2][1];
+        m[2][2] = data[0][0] * data[1][1] - data[0][1] * data[1][0];
+
+        // Expanding along the first row reuses the cofactors in the first column.
+        T invDet = 1 / (data[0][0] * m[0][0] + data[0][1] * m[1][0] + data[0][2] * m[2][0]);
+        for (int i = 0; i < SIZE; ++i) {
+            for (int j = 0; j < SIZE; ++j) {
+                m[i][j] *= invDet;
+            }
+        }
+        return m;
+    }
 
     // Extract the scaling matrix from this linear transformation.
-    Mat3 extractScaling() const;
+    constexpr Mat3 extractScaling() const {
+        Mat3 m{};
+        m[0][0] = data[0][0];
+        m[1][1] = data[1][1];
+        m[2][2] = data[2][2];
+        return m;
+    }
 
     // Return the size of this matrix.
-    int size();
-
-    // Send a formatted string representation of the matrix to an output stream.
-    friend std::ostream &operator<<(std::ostream &os, const Mat3 &m);
+    constexpr int size() const { return SIZE; }
 };
 
 // A 4x4 matrix. Used for affine transformations.
-class Mat4 {
- private:
+template <typename T>
+class Mat4T {
+    using Vec3 = Vec3T<T>;
+    using Pnt3 = Pnt3T<T>;
+    using Mat3 = Mat3T<T>;
+    using Mat4 = Mat4T<T>;
+
+ public:
     static const int SIZE = 4;
 
-    // Internal representation of the matrix.
-    double data[SIZE][SIZE];
+ private:
+    // Internal representation of the matrix. With RAYTRACER_SIMD each row is
+    // aligned to fill a SIMD register.
+    alignas(simd::ALIGNMENT<T>) T data[SIZE][SIZE];
 
  public:
     // Default constructor creates a 4x4 zero matrix.
-    Mat4();
+    constexpr Mat4T() : data{} {}
+
+    // Create a matrix from a braced list of rows, e.g.
+    // Mat4{{1, 0, 0, x}, {0, 1, 0, y}, {0, 0, 1, z}, {0, 0, 0, 1}}. Missing
+    // rows and elements are zero and extra ones are ignored. Nothing is
+    // allocated.
+    constexpr Mat4T(std::initializer_list<std::initializer_list<T>> rows) : data{} {
+        int i = 0;
+        for (auto row = rows.begin(); row != rows.end() && i < SIZE; ++row, ++i) {
+            int j = 0;
+            for (auto elem = row->begin(); elem != row->end() && j < SIZE; ++elem, ++j) {
+                data[i][j] = *elem;
+            }
+        }
+    }
+
+    // Create a matrix from an array of rows.
+    constexpr explicit Mat4T(const std::array<std::array<T, SIZE>, SIZE> &rows) {
+        for (int i = 0; i < SIZE; ++i) {
+            for (int j = 0; j < SIZE; ++j) {
+                data[i][j] = rows[i][j];
+            }
+        }
+    }
 
-    // Create a matrix from an array.
-    Mat4(const std::vector<std::vector<double>> arr);
+    // Create a matrix from 16 elements in row-major order, such as a slice of a
+    // buffer read by a scene loader.
+    constexpr explicit Mat4T(std::span<const T, SIZE * SIZE> elements) {
+        for (int i = 0; i < SIZE; ++i) {
+            for (int j = 0; j < SIZE; ++j) {
+                data[i][j] = elements[i * SIZE + j];
+            }
+        }
+    }
 
-    // Copy constructor
-    Mat4(const Mat4 &other);
+    // Convert a matrix of another scalar type.
+    template <typename U>
+    constexpr explicit Mat4T(const Mat4T<U> &m) {
+        for (int i = 0; i < SIZE; ++i) {
+            for (int j = 0; j < SIZE; ++j) {
+                data[i][j] = static_cast<T>(m[i][j]);
+            }
+        }
+    }
 
     // Construct an affine matrix from a 3x3 transformation matrix and a
     // translation vector.
-    Mat4(const Mat3 &linear, Vec3 translation);
+    constexpr Mat4T(const Mat3 &linear, Vec3 translation) : data{} {
+        fill(linear);
+        data[0][3] = translation.x;
+        data[1][3] = translation.y;
+        data[2][3] = translation.z;
+        data[3][3] = 1;
+    }
 
-    // Computes the inverse of this matrix and return it.
-    Mat4 inverse() const;
+    // Compute the inverse of this affine matrix and return it. The linear part is
+    // inverted through its adjugate, so any invertible combination of rotation,
+    // scaling and shear is handled. Singular matrices produce infinities.
+    constexpr Mat4 inverse() const {
+        Mat3 inverseLinear = extractLinear().inverse();
+        Vec3 inverseTrans = inverseLinear * Vec3{-data[0][3], -data[1][3], -data[2][3]};
+        return Mat4{inverseLinear, inverseTrans};
+    }
 
     // Extract the linear component of this affine transformation. The linear
     // component corresponds to the 3x3 submatrix contained in the top left of an
     // affine matrix.
-    Mat3 extractLinear() const;
+    constexpr Mat3 extractLinear() const {
+        Mat3 m{};
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                m[i][j] = data[i][j];
+            }
+        }
+        return m;
+    }
 
     // Matrix-point multiplication. Unlike vectors, points can be translated.
-    Pnt3 operator*(const Pnt3 &other) const;
+    constexpr Pnt3 operator*(const Pnt3 &other) const {
+        // The homogeneous lane of the point picks up the translation column.
+        if constexpr (simd::ENABLED) return Pnt3::fromPack(transform(other.pack()));
+        return Pnt3{data[0][0] * other.x + data[0][1] * other.y +
+                            data[0][2] * other.z + data[0][3],
+                    data[1][0] * other.x + data[1][1] * other.y +
+                            data[1][2] * other.z + data[1][3],
+                    data[2][0] * other.x + data[2][1] * other.y +
+                            data[2][2] * other.z + data[2][3]};
+    }
 
     // Matrix-vector multiplcation.
-    Vec3 operator*(const Vec3 &other) const;
+    constexpr Vec3 operator*(const Vec3 &other) const {
+        if constexpr (simd::ENABLED) return Vec3::fromPack(transform(other.pack()));
+        return Vec3(data[0][0] * other.x + data[0][1] * other.y + data[0][2] * other.z,
+                    data[1][0] * other.x + data[1][1] * other.y + data[1][2] * other.z,
+                    data[2][0] * other.x + data[2][1] * other.y + data[2][2] * other.z);
+    }
 
     // Increment the translational component of the matrix to the location given
     // by a point.
-    void translate(Pnt3 p);
+    constexpr void translate(Pnt3 p) {
+        data[0][3] = p.x;
+        data[1][3] = p.y;
+        data[2][3] = p.z;
+    }
 
     // Increment the translational component of the matrix along each axis.
-    void translate(double dx, double dy, double dz);
+    constexpr void translate(T dx, T dy, T dz) {
+        data[0][3] += dx;
+        data[1][3] += dy;
+        data[2][3] += dz;
+    }
 
     // Set the translational component of this matrix to the given configuration.
-    void setTranslate(double x, double y, double z);
+    constexpr void setTranslate(T x, T y, T z) {
+        data[0][3] = x;
+        data[1][3] = y;
+        data[2][3] = z;
+    }
 
     // Increase the scaling component of this matrix by a constant factor along
     // each axis. If you want to scale unevenly, then use the version of this
     // method that passes 3 arguments.
-    void scale(double scalar);
+    constexpr void scale(T scalar) {
+        data[0][0] *= scalar;
+        data[1][1] *= scalar;
+        data[2][2] *= scalar;
+    }
 
     // Increase the scaling component along each axis by factors kx, ky, and kz
     // for the x, y, and z axes respectively.
-    void scale(double kx, double ky, double kz);
+    constexpr void scale(T kx, T ky, T kz) {
+        data[0][0] *= kx;
+        data[1][1] *= ky;
+        data[2][2] *= kz;
+    }
 
     // Get the length of a particular column.
-    double getLength(int col) const;
+    T getLength(int col) const {
+        return std::sqrt((data[0][col] * data[0][col]) +
+                         (data[1][col] * data[1][col]) +
+                         (data[2][col] * data[2][col]));
+    }
 
     // Matrix-Matrix multiplication.
-    Mat4 operator*(const Mat4 &other) const;
+    constexpr Mat4 operator*(const Mat4 &other) const {
+        Mat4 result{};
+        for (int i = 0; i < SIZE; ++i) {
+            for (int j = 0; j < SIZE; ++j) {
+                for (int k = 0; k < SIZE; ++k) {
+                    result[i][j] += data[i][k] * other[k][j];
+                }
+            }
+        }
+        return result;
+    }
+
+    // Multiply the matrix by a column of four lanes. Each lane of the result is
+    // the horizontal sum of one row multiplied by the column. The four sums are
+    // reduced together, which is much cheaper than reducing each row alone.
+    simd::Pack4<T> transform(simd::Pack4<T> column) const {
+        using Pack = simd::Pack4<T>;
+        return Pack::sums(Pack::load(data[0]) * column, Pack::load(data[1]) * column,
+                          Pack::load(data[2]) * column, Pack::load(data[3]) * column);
+    }
 
     // Overload's the [] operator so that you can index into data to get
     // individual elements.
-    double *operator[](int row);
+    constexpr T *operator[](int row) { return data[row]; }
 
     // Constant version of the [] overload. Read-only access.
-    const double *operator[](int row) const;
+    constexpr const T *operator[](int row) const { return data[row]; }
 
     // Fill the top left 3x3 submatrix with the given matrix.
-    void fill(Mat3 m);
-
-    // Send a formatted string representation of the matrix to an output stream.
-    friend std::ostream &operator<<(std::ostream &os, const Mat4 &m);
+    constexpr void fill(const Mat3 &m) {
+        for (int i = 0; i < m.size(); ++i) {
+            for (int j = 0; j < m.size(); ++j) {
+                data[i][j] = m[i][j];
+            }
+        }
+    }
 
     // Create a 4x4 identity matrix and return it.
-    static Mat4 identity();
+    static constexpr Mat4 identity() {
+        Mat4 result{};
+        result[0][0] = 1;
+        result[1][1] = 1;
+        result[2][2] = 1;
+        result[3][3] = 1;
+        return result;
+    }
 };
 
 // Represents a ray that shoots out into space in a straight line from some
 // origin point.
-struct Ray {
+template <typename T>
+struct RayT {
+    using Pnt3 = Pnt3T<T>;
+    using Vec3 = Vec3T<T>;
+    using Mat4 = Mat4T<T>;
+    using Ray = RayT<T>;
+
     Pnt3 origin;
     Vec3 direction;
 
     // Apply an affine transformation to the ray and return the new ray.
-    Ray transformed(const Mat4 &m) const;
+    constexpr Ray transformed(const Mat4 &m) const {
+        return Ray{m * origin, m * direction};
+    }
 
     // Apply an affine transformation to the ray.
-    void transform(const Mat4 &m);
+    constexpr void transform(const Mat4 &m) {
+        origin = m * origin;
+        direction = m * direction;
+    }
 
     // Return the point at t.
-    Pnt3 at(double t) const;
+    constexpr Pnt3 at(T t) const {
+        using Pack = simd::Pack4<T>;
+        if constexpr (simd::ENABLED) {
+            return Pnt3::fromPack(fmadd(direction.pack(), Pack::broadcast(t), origin.pack()));
+        }
+        return origin + direction * t;
+    }
+};
+
+// A batch of rays stored as a structure of arrays. Each component of the
+// origins and directions is contiguous, so operations on the whole batch
+// vectorize across rays rather than across the three components of one ray.
+template <typename T>
+struct RayStreamT {
+    using Pnt3 = Pnt3T<T>;
+    using Vec3 = Vec3T<T>;
+    using Mat4 = Mat4T<T>;
+    using Ray = RayT<T>;
+    using RayStream = RayStreamT<T>;
+
+    std::vector<T> ox, oy, oz;  // origins
+    std::vector<T> dx, dy, dz;  // directions
+
+    // Return the number of rays in the stream.
+    size_t size() const { return ox.size(); }
+
+    // Resize the stream to hold n rays.
+    void resize(size_t n) {
+        ox.resize(n);
+        oy.resize(n);
+        oz.resize(n);
+        dx.resize(n);
+        dy.resize(n);
+        dz.resize(n);
+    }
+
+    // Remove every ray, keeping the capacity.
+    void clear() { resize(0); }
+
+    // Append a ray to the end of the stream.
+    void push(const Ray &ray) {
+        ox.push_back(ray.origin.x);
+        oy.push_back(ray.origin.y);
+        oz.push_back(ray.origin.z);
+        dx.push_back(ray.direction.x);
+        dy.push_back(ray.direction.y);
+        dz.push_back(ray.direction.z);
+    }
+
+    // Store a ray at index i.
+    void set(size_t i, const Ray &ray) {
+        ox[i] = ray.origin.x;
+        oy[i] = ray.origin.y;
+        oz[i] = ray.origin.z;
+        dx[i] = ray.direction.x;
+        dy[i] = ray.direction.y;
+        dz[i] = ray.direction.z;
+    }
+
+    // Return the ray at index i.
+    Ray get(size_t i) const {
+        return Ray{Pnt3{ox[i], oy[i], oz[i]}, Vec3(dx[i], dy[i], dz[i])};
+    }
+
+    // Apply an affine transformation to every ray and store the result in out,
+    // which is resized to match. Each matrix entry is loaded once for the whole
+    // batch, and the loops compile to packed multiply-adds over as many rays as
+    // fit a register. out must not be this stream.
+    void transformed(const Mat4 &m, RayStream &out) const { transformed(m, 0, size(), out); }
+
+    // Transform the n rays starting at first into out, which is resized to n.
+    void transformed(const Mat4 &m, size_t first, size_t n, RayStream &out) const {
+        out.resize(n);
+        transformArrays<true>(m, n, ox.data() + first, oy.data() + first, oz.data() + first,
+                              out.ox.data(), out.oy.data(), out.oz.data());
+        transformArrays<false>(m, n, dx.data() + first, dy.data() + first, dz.data() + first,
+                               out.dx.data(), out.dy.data(), out.dz.data());
+    }
+
+ private:
+    // Multiply n points (or vectors, which ignore the translation) stored as
+    // separate x, y and z arrays by m. The outputs are restrict qualified so
+    // that the compiler can vectorize without checking for overlap.
+    template <bool translate>
+    static void transformArrays(const Mat4 &m, size_t n, const T *x, const T *y,
+                                const T *z, T *__restrict outX, T *__restrict outY,
+                                T *__restrict outZ) {
+        const T m00 = m[0][0], m01 = m[0][1], m02 = m[0][2], m03 = m[0][3];
+        const T m10 = m[1][0], m11 = m[1][1], m12 = m[1][2], m13 = m[1][3];
+        const T m20 = m[2][0], m21 = m[2][1], m22 = m[2][2], m23 = m[2][3];
+        for (size_t i = 0; i < n; ++i) {
+            if constexpr (translate) {
+                outX[i] = m00 * x[i] + m01 * y[i] + m02 * z[i] + m03;
+                outY[i] = m10 * x[i] + m11 * y[i] + m12 * z[i] + m13;
+                outZ[i] = m20 * x[i] + m21 * y[i] + m22 * z[i] + m23;
+            } else {
+                outX[i] = m00 * x[i] + m01 * y[i] + m02 * z[i];
+                outY[i] = m10 * x[i] + m11 * y[i] + m12 * z[i];
+                outZ[i] = m20 * x[i] + m21 * y[i] + m22 * z[i];
+            }
+        }
+    }
+};
+
+// Send a formatted string version of the vector to an ostream. Vectors are
+// denoted by square brackets [].
+template <typename T>
+std::ostream &operator<<(std::ostream &os, const Vec3T<T> &v);
+
+// Display this point on an output stream.
+template <typename T>
+std::ostream &operator<<(std::ostream &os, const Pnt3T<T> &p);
+
+// Send a formatted string representation of the matrix to an output stream.
+template <typename T>
+std::ostream &operator<<(std::ostream &os, const Mat3T<T> &m);
+
+// Send a formatted string representation of the matrix to an output stream.
+template <typename T>
+std::ostream &operator<<(std::ostream &os, const Mat4T<T> &m);
+
+using Vec3 = Vec3T<Real>;
+using Pnt3 = Pnt3T<Real>;
+using Mat3 = Mat3T<Real>;
+using Mat4 = Mat4T<Real>;
+using Ray = RayT<Real>;
+using RayStream = RayStreamT<Real>;
+
+// A ray packed into 32 bytes, for batches of millions of rays such as the
+// queues of a wavefront renderer. The components are single precision whatever
+// Real is. The ray covers the points origin + t * direction for
+// tMin <= t < tMax.
+struct CompactRay {
+    float origin[3];
+    float tMin;
+    float direction[3];
+    float tMax;
+
+    // Pack a ray and the range of t to search along it.
+    static constexpr CompactRay from(const Ray &ray, float tMin = 0,
+                                     float tMax = INFINITY) {
+        return CompactRay{{float(ray.origin.x), float(ray.origin.y), float(ray.origin.z)},
+                          tMin,
+                          {float(ray.direction.x), float(ray.direction.y),
+                           float(ray.direction.z)},
+                          tMax};
+    }
+
+    // Unpack the ray, dropping its range.
+    constexpr Ray toRay() const {
+        return Ray{Pnt3{origin[0], origin[1], origin[2]},
+                   Vec3(direction[0], direction[1], direction[2])};
+    }
 };
+static_assert(sizeof(CompactRay) == 32);
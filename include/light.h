@@ -2,85 +2,134 @@
 #include <algorithm>
 #include "geometry.h"
 
-// Encodes an RGBA value.
-struct Color {
-    double r;
-    double g;
-    double b;
-    double a;
-
-    // Create a pixel with default alpha (1.0).
-    Color(double r, double g, double b) : r(r), g(g), b(b), a(1.0){};
-
-    // Create a pixel with the given rgba values.
-    Color(double r, double g, double b, double a) : r(r), g(g), b(b), a(a){};
+// Encodes an RGB radiance value. With RAYTRACER_SIMD the channels are padded
+// to four lanes and arithmetic runs on a single SIMD register.
+template <typename T>
+struct alignas(simd::ALIGNMENT<T>) ColorT {
+    using Color = ColorT<T>;
+    using Pack = simd::Pack4<T>;
+
+    T r;
+    T g;
+    T b;
+#ifdef RAYTRACER_SIMD
+    T pad = 0;  // padding lane, always zero
+#endif
+
+    // Create a color from its rgb channels.
+    constexpr ColorT(T r, T g, T b) : r(r), g(g), b(b) {}
+
+    // Create a color from a pack, including its padding lane.
+    static Color fromPack(Pack p) {
+        if constexpr (simd::ENABLED) {
+            Color c{0, 0, 0};
+            p.store(&c.r);
+            return c;
+        }
+        T lanes[4];
+        p.store(lanes);
+        return Color{lanes[0], lanes[1], lanes[2]};
+    }
+
+    // Load the channels into a pack. Without RAYTRACER_SIMD the color has no
+    // padding lane, so the channels are copied and the last lane is zero.
+    Pack pack() const {
+        if constexpr (simd::ENABLED) return Pack::load(&r);
+        const T lanes[4] = {r, g, b, 0};
+        return Pack::load(lanes);
+    }
 
     // Multiply all of the channels of the color by a scalar.
-    Color operator*(const double scalar) const;
+    constexpr Color operator*(const T scalar) const {
+        if constexpr (simd::ENABLED) return fromPack(pack() * Pack::broadcast(scalar));
+        return Color(r * scalar, g * scalar, b * scalar);
+    }
 
     // Divive all of the channels of a color by a scalar.
-    Color operator/(double scalar) const;
+    constexpr Color operator/(T scalar) const {
+        if constexpr (simd::ENABLED) return fromPack(pack() / Pack::broadcast(scalar));
+        return Color(r / scalar, g / scalar, b / scalar);
+    }
 
     // Multiply a color by another color. The product of two colors is the product
     // of the individual channels.
-    Color operator*(const Color &c) const;
+    constexpr Color operator*(const Color &c) const {
+        if constexpr (simd::ENABLED) return fromPack(pack() * c.pack());
+        return Color(r * c.r, g * c.g, b * c.b);
+    }
 
     // Add two colors together. The sum of two colors is the sum of the individual
     // channels.
-    Color operator+(const Color &c) const;
+    constexpr Color operator+(const Color &c) const {
+        if constexpr (simd::ENABLED) return fromPack(pack() + c.pack());
+        return Color(r + c.r, g + c.g, b + c.b);
+    }
 
     // Subtract two colors. The different between two colors is the difference
     // between their individual channels.
-    Color operator-(const Color &c) const;
+    constexpr Color operator-(const Color &c) const {
+        if constexpr (simd::ENABLED) return fromPack(pack() - c.pack());
+        return Color(r - c.r, g - c.g, b - c.b);
+    }
 
     // Increment this color by another one. Adds the other color's rgb values to
     // this color.
-    void operator+=(const Color &c);
+    constexpr void operator+=(const Color &c) { *this = *this + c; }
 
     // Blend this color with another one.
-    void operator*=(const Color &c);
+    constexpr void operator*=(const Color &c) { *this = *this * c; }
 
-    void operator*=(const float scalar);
+    constexpr void operator*=(const T scalar) { *this = *this * scalar; }
 
     // Divide the rgb channels of this color by a scalar.
-    void operator/=(const double scalar);
+    constexpr void operator/=(const T scalar) { *this = *this / scalar; }
 
     // Clamp the rgb channels so that their values are between 0 and 1.
-    void clamp();
-
-    // Send a string representation of the pixel to an output stream.
-    friend std::ostream &operator<<(std::ostream &os, const Color &p);
+    constexpr void clamp() {
+        if constexpr (simd::ENABLED) {
+            *this = fromPack(min(max(pack(), Pack::broadcast(0)), Pack::broadcast(1)));
+            return;
+        }
+        r = std::clamp(r, T(0), T(1));
+        g = std::clamp(g, T(0), T(1));
+        b = std::clamp(b, T(0), T(1));
+    }
+
+    // Return the perceived brightness of the color.
+    constexpr T luminance() const { return T(0.2126) * r + T(0.7152) * g + T(0.0722) * b; }
 
     // Return a string representation of the color.
     std::string toString() const;
 
     // Return the color white.
-    static Color white();
+    static constexpr Color white() { return Color{1, 1, 1}; }
 
     // Return the color black.
-    static Color black();
+    static constexpr Color black() { return Color{0.1, 0.1, 0.1}; }
 
     // Return the color red.
-    static Color red();
+    static constexpr Color red() { return Color{1, 0, 0}; }
 
     // Return the color blue.
-    static Color blue();
+    static constexpr Color blue() { return Color{0, 0, 1}; }
 
     // Return the color green.
-    static Color green();
+    static constexpr Color green() { return Color{0, 1, 0}; }
 
     // Return the color grey.
-    static Color grey();
+    static constexpr Color grey() { return Color{0.5, 0.5, 0.5}; }
 };
 
+using Color = ColorT<Real>;
+
 // A point light.
 class Light {
 public:
-    double intensity;
+    Real intensity;
     Pnt3 center;
     Color color;
 
-    Light(double intensity, const Pnt3 &center, const Color &color)
+    Light(Real intensity, const Pnt3 &center, const Color &color)
             : intensity(intensity), center(center), color(color) {}
 
     virtual ~Light() {}
@@ -93,14 +142,14 @@ public:
     Vec3 direction;
 
     // The width of the square.
-    double width;
+    Real width;
 
 public:
     // Create a square light. The direction of the light should be a unit vector.
-    SquareLight(double intensity, const Pnt3 &center, const Color &color,
-                            const Vec3 &direction, const double width)
+    SquareLight(Real intensity, const Pnt3 &center, const Color &color,
+                            const Vec3 &direction, const Real width)
             : Light{intensity, center, color}, direction(direction), width(width) {}
 
-    // Get a list of random points on the area of the light.
-    std::vector<Pnt3> getRandomPoints(unsigned samples) const;
+    // Map a point in the unit square to a point on the area of the light.
+    Pnt3 samplePoint(Real u, Real v) const;
 };
\ No newline at end of file
@@ -1,16 +1,65 @@
 #pragma once
+#include <cstdint>
 #include <memory>
 #include <optional>
+#include <vector>
 #include "light.h"
 
-class Object;
+// The kinds of primitive a scene can hold. A scene stores each kind in its
+// own array.
+enum PrimitiveType {
+    SpherePrimitive,
+};
+
+// Identifies a primitive stored in a Primitives. The type selects the array
+// and the index is the position in it.
+struct PrimitiveHandle {
+    PrimitiveType type;
+    std::uint32_t index;
+
+    // The number of bits of a packed handle that hold the index. This limits a
+    // scene to 2^28 primitives of each type.
+    static const int INDEX_BITS = 28;
+
+    // Pack the handle into 32 bits, with the type in the top bits.
+    constexpr std::uint32_t pack() const {
+        return (static_cast<std::uint32_t>(type) << INDEX_BITS) | index;
+    }
+
+    // Unpack a handle packed by pack.
+    static constexpr PrimitiveHandle unpack(std::uint32_t id) {
+        return PrimitiveHandle{static_cast<PrimitiveType>(id >> INDEX_BITS),
+                               id & ((1u << INDEX_BITS) - 1)};
+    }
+};
 
 struct Hit {
-    std::shared_ptr<Object> object;
+    PrimitiveHandle primitive;
     Pnt3 point;
     Vec3 direction;
-    double minusT;
-    double plusT;
+    Real minusT;
+    Real plusT;
+};
+
+// The closest hit of a CompactRay, packed into 20 bytes. Scene::intersect
+// writes t and the primitive, and Scene::surfaceCoords u and v. The pixel is
+// not written by either: the stage that creates a ray stores the pixel the ray
+// contributes to in the hit at the same index, where it stays next to the
+// result.
+struct CompactHit {
+    // The packed primitive of a ray that hit nothing.
+    static constexpr std::uint32_t NONE = 0xffffffff;
+
+    float t;                  // the distance along the ray to the hit
+    std::uint32_t primitive;  // the packed PrimitiveHandle that was hit, or NONE
+    float u, v;               // the surface coordinates of the hit, in [0, 1]
+    std::uint32_t pixel;      // row * width + col of the pixel the ray is for
+};
+static_assert(sizeof(CompactHit) == 20);
+
+// An axis-aligned box in world space.
+struct Bounds {
+    Pnt3 lower, upper;
 };
 
 // Determines the shape of an object.
@@ -19,21 +68,28 @@ protected:
     // An affine matrix that tells you how to get from object to world space.
     Mat4 transform;
 
+    // The inverse of the transform. Recomputed whenever the transform changes
+    // so that tracing a ray never has to invert a matrix.
+    Mat4 inverseTransform;
+
+    // Replace the transform and update its inverse.
+    void setTransform(const Mat4 &m);
+
 public:
     // Return the inverse of the transform matrix of this object.
-    Mat4 inverse() const;
+    const Mat4 &inverse() const { return inverseTransform; }
 
     // Move this object to the given location.
-    Geometry &move(double x, double y, double z);
+    Geometry &move(Real x, Real y, Real z);
 
     // Translate this object.
-    Geometry &translate(double dx, double dy, double dz);
+    Geometry &translate(Real dx, Real dy, Real dz);
 
     // Apply uniform scaling to this object.
-    Geometry &scale(double scalar);
+    Geometry &scale(Real scalar);
 
     // Apply non-uniform scaling to this object.
-    Geometry &scale(double kx, double ky, double kz);
+    Geometry &scale(Real kx, Real ky, Real kz);
 
     // Change the object to a different coordinate system.
     void setCoordSystem(Mat4 m);
@@ -42,39 +98,68 @@ public:
     Mat4 getTransform() const { return transform; }
 
     // Get the time it takes for a ray to hit this object.
-    virtual std::optional<std::pair<double, double>> hit(const Ray &r) const = 0;
+    virtual std::optional<std::pair<Real, Real>> hit(const Ray &r) const = 0;
+
+    // Intersect every ray of a stream with this object. The entry and exit
+    // times of ray i are written to minusT[i] and plusT[i], and are NaN when the
+    // ray misses. The default implementation intersects one ray at a time.
+    virtual void hit(const RayStream &rays, Real *minusT, Real *plusT) const;
 
     // Get the surface normal at point p.
     virtual Vec3 normal(const Pnt3 &p) const = 0;
 
-    // Invert a surface normal using the inverse matrix of the object.
+    // Return the kind of primitive this geometry is.
+    virtual PrimitiveType type() const = 0;
+
+    // Map an object space surface normal to world space using the inverse
+    // matrix of the object.
     static Vec3 invertNormal(const Vec3 &normal, const Mat4 &inverse);
 };
 
-// A sphere with a radius and center.
-class Sphere : public Geometry {
+// A sphere with a radius and center. Final, so that intersecting an array of
+// spheres calls Sphere::hit directly.
+class Sphere final : public Geometry {
 public:
     // Create a unit sphere.
-    Sphere() { transform = Mat4::identity(); }
+    Sphere() { setTransform(Mat4::identity()); }
 
     // Create a sphere with a given center and radius.
-    Sphere(Pnt3 center, double radius) {
-        transform = Mat4::identity();
-        transform.scale(radius);
-        transform.translate(center);
+    Sphere(Pnt3 center, Real radius) {
+        Mat4 m = Mat4::identity();
+        m.scale(radius);
+        m.translate(center);
+        setTransform(m);
     }
 
     // Return the radius of this sphere.
-    double radius() const;
+    Real radius() const;
 
     // Return the center of this sphere.
     Pnt3 center() const;
 
+    // Return the smallest box around this sphere in world space. Exact under
+    // any affine transform.
+    Bounds bounds() const;
+
     // Get the time it takes for a ray to hit this sphere in object space.
-    std::optional<std::pair<double, double>> hit(const Ray &r) const override;
+    std::optional<std::pair<Real, Real>> hit(const Ray &r) const override;
+
+    // Intersect a stream of rays with this sphere in object space.
+    void hit(const RayStream &rays, Real *minusT, Real *plusT) const override;
+
+    // Intersect a stream of object space rays with the unit sphere. Works the
+    // same way as the stream overload of hit, in either precision.
+    template <typename T>
+    static void hitUnit(const RayStreamT<T> &rays, T *minusT, T *plusT);
+
+    // Return the surface coordinates of a point on the unit sphere: u goes
+    // around the y axis and v from the top pole to the bottom one.
+    static std::pair<float, float> surfaceCoords(float x, float y, float z);
 
     // Get the surface normal at point p for this sphere in object space.
     Vec3 normal(const Pnt3 &p) const override;
+
+    PrimitiveType type() const override { return SpherePrimitive; }
 };
 
 // Represents a material in the Blinn-Phong illumination model. The ambient,
@@ -90,35 +175,116 @@ enum MaterialType {
     Plastic,
     PolishedMetal,
     Glass,
+    // Materials whose coefficients were given directly.
+    CustomMaterial,
 };
 
+// The number of material types.
+inline constexpr size_t MATERIAL_TYPES = CustomMaterial + 1;
+
 struct Material {
     Color color;
-    double ambient;
-    double diffuse;
-    double specular;
-    double shininess;
-    double reflectance;
-    double transparency;
-
-    Material(Color color, double ambient, double diffuse, double specular,
-           double shininess, double reflectance, double transparency,
-           double refractiveIndex)
+    Real ambient;
+    Real diffuse;
+    Real specular;
+    Real shininess;
+    Real reflectance;
+    Real transparency;
+
+    // The preset the material was made from.
+    MaterialType type = CustomMaterial;
+
+    Material(Color color, Real ambient, Real diffuse, Real specular,
+           Real shininess, Real reflectance, Real transparency,
+           Real refractiveIndex)
             : color(color), ambient(ambient), diffuse(diffuse), specular(specular),
                 shininess(shininess), reflectance(reflectance),
                 transparency(transparency) {}
 
-    static std::shared_ptr<Material> from(const MaterialType type,
-                                                                                const Color &color);
+    static Material from(const MaterialType type, const Color &color);
+};
+
+// Identifies a material in a MaterialTable.
+using MaterialId = std::uint32_t;
+
+// Stores all of the materials of a scene next to each other. Objects refer to
+// their material by id, so many objects can share one material without
+// holding a pointer to it.
+class MaterialTable {
+private:
+    std::vector<Material> materials;
+
+public:
+    // Add a material to the table and return its id.
+    MaterialId add(const Material &material) {
+        materials.push_back(material);
+        return static_cast<MaterialId>(materials.size() - 1);
+    }
+
+    // Get the material with the given id.
+    const Material &operator[](MaterialId id) const { return materials[id]; }
+
+    // Return the number of materials in the table.
+    size_t size() const { return materials.size(); }
 };
 
 // A renderable object. An object has a geometry which determines its shape,
 // and a material which determines how it interacts with light.
 struct Object {
     std::shared_ptr<Geometry> geometry;
-    std::shared_ptr<Material> material;
+    MaterialId material;
 
     // Create an object.
-    Object(std::shared_ptr<Geometry> geometry, std::shared_ptr<Material> material)
+    Object(std::shared_ptr<Geometry> geometry, MaterialId material)
             : geometry(geometry), material(material) {}
 };
+
+// Stores the primitives of a scene by value, in one contiguous array per type,
+// with the id of each primitive's material in a parallel array. Intersecting
+// the scene walks the arrays in order instead of following a pointer to every
+// object and its geometry. A handle stays valid as more primitives are added.
+class Primitives {
+private:
+    std::vector<Sphere> spheres;
+    std::vector<MaterialId> sphereMaterials;
+
+    // Copies of the inverse transforms of the spheres. Intersection reads
+    // nothing else, so it streams through 128 bytes per sphere instead of the
+    // whole Sphere.
+    std::vector<Mat4> sphereInverses;
+
+    // The world space bounds of the spheres, used to skip spheres that a
+    // whole batch of rays points away from.
+    std::vector<Bounds> sphereBounds;
+
+public:
+    // Add a sphere and return its handle.
+    PrimitiveHandle add(const Sphere &sphere, MaterialId material);
+
+    // Copy the geometry of an object into the array for its type and return its
+    // handle.
+    PrimitiveHandle add(const Object &obj);
+
+    // Get the geometry of a primitive.
+    const Geometry &geometry(PrimitiveHandle handle) const;
+
+    // Get the material id of a primitive.
+    MaterialId material(PrimitiveHandle handle) const;
+
+    // Give a primitive a new object to world transform, and refit the inverse
+    // and bounds kept for it in place.
+    void setTransform(PrimitiveHandle handle, const Mat4 &transform);
+
+    // Return all of the spheres. The sphere at index i has the handle
+    // {SpherePrimitive, i}.
+    const std::vector<Sphere> &getSpheres() const { return spheres; }
+
+    // Return the inverse transforms of the spheres, in the same order.
+    const std::vector<Mat4> &getSphereInverses() const { return sphereInverses; }
+
+    // Return the bounds of the spheres, in the same order.
+    const std::vector<Bounds> &getSphereBounds() const { return sphereBounds; }
+
+    // Return the number of primitives of every type.
+    size_t size() const { return spheres.size(); }
+};
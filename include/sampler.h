@@ -0,0 +1,93 @@
+#pragma once
+#include <cstdint>
+#include "geometry.h"
+
+// The sequence used to generate sample positions. Every sampler is
+// decorrelated per pixel and per dimension, so no two pixels share the same
+// pattern.
+//
+// Independent: uncorrelated uniform random numbers. Useful as a reference.
+// Stratified: jittered samples with one sample per stratum.
+// Sobol: the Sobol (0,2)-sequence with Owen scrambling, padded across
+// dimensions. Converges fastest for smooth integrands.
+// BlueNoise: a Sobol sequence that is shared between pixels but rotated by a
+// per-pixel blue noise offset, which pushes the remaining error into high
+// frequencies where it is much less visible.
+enum SamplerType {
+    Independent,
+    Stratified,
+    Sobol,
+    BlueNoise,
+};
+
+// A point in the unit square.
+struct Point2 {
+    Real u, v;
+};
+
+class Sampler;
+
+// A group of n 2D samples that are taken at the same path vertex, such as the
+// shadow rays of a single light. The samples are stratified with respect to
+// each other as well as to the samples taken by other pixel samples.
+class SampleStream {
+private:
+    const Sampler &sampler;
+    uint32_t dimension;
+    unsigned count;
+
+public:
+    SampleStream(const Sampler &sampler, uint32_t dimension, unsigned count)
+            : sampler(sampler), dimension(dimension), count(count) {}
+
+    // Return the k-th sample of the stream. k should be less than the count.
+    Point2 get(unsigned k) const;
+};
+
+// Generates the random numbers used by the renderer. A sampler is started for
+// each pixel sample, after which every call consumes a new dimension: the
+// camera, lens, light and BSDF samples of a path each get a dimension of their
+// own. Samples are a pure function of the seed, pixel, sample index and
+// dimension, so the image does not depend on the order pixels are traced in.
+class Sampler {
+private:
+    SamplerType type;
+    unsigned samplesPerPixel;
+    uint32_t seed;
+
+    int px = 0, py = 0;
+    uint32_t pixelHash = 0;
+    uint32_t sampleIndex = 0;
+    uint32_t dimension = 0;
+
+    friend class SampleStream;
+
+    // Return sample i of n for a dimension.
+    Point2 sample(uint32_t dim, uint32_t i, uint32_t n) const;
+
+public:
+    // Create a sampler. The number of samples per pixel is used by the
+    // stratified sampler to size its strata.
+    Sampler(SamplerType type, unsigned samplesPerPixel, uint32_t seed = 0)
+            : type(type), samplesPerPixel(samplesPerPixel), seed(seed) {}
+
+    // Begin generating the given sample of the pixel at column x and row y.
+    void startPixelSample(int x, int y, unsigned index);
+
+    // Continue the current pixel sample from the given dimension. Renderers
+    // that do not trace a path depth first use this to give each vertex the
+    // same dimensions no matter when it is reached.
+    void setDimension(uint32_t d) { dimension = d; }
+
+    // Return a 1D sample for the next dimension.
+    Real get1D();
+
+    // Return a 2D sample for the next dimension.
+    Point2 get2D();
+
+    // Reserve the next dimension for n samples taken at the same path vertex.
+    SampleStream stream2D(unsigned n);
+
+    // Return the type of sequence this sampler generates.
+    SamplerType getType() const { return type; }
+};
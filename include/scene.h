@@ -1,7 +1,16 @@
 #pragma once
+#include <chrono>
 #include <cmath>
+#include "arena.h"
 #include "lodepng.h"
+#include "film.h"
 #include "object.h"
+#include "sampler.h"
+#include "stats.h"
+#include "timeline.h"
+
+class ImageWriter;
+class Wavefront;
 
 class Image {
 private:
@@ -29,13 +38,27 @@ public:
 
     // Save the image at a desired path
     bool save(const std::string &path);
+
+    // Load a PNG into the image. Fails and leaves the image as it was if the
+    // file can't be decoded or has different dimensions.
+    bool load(const std::string &path);
+
+    // Set every pixel to transparent black, like a newly created image.
+    void clear();
+
+    // Return the RGBA bytes of the image, row by row from the top.
+    const unsigned char *data() const { return imgbuf.data(); }
+
+    // Copy width x height RGBA pixels, laid out like data(), into the image
+    // with their top left pixel at the given column and row.
+    void paste(const unsigned char *pixels, int width, int height, int x, int y);
 };
 
 // Where the image is created.
 class Viewport {
 private:
-    double width;
-    double height;
+    Real width;
+    Real height;
     std::shared_ptr<Image> img;
 
 public:
@@ -44,20 +67,20 @@ public:
 
     // Create a viewport with the given width and image width and synchronize
     // their aspect ratios.
-    Viewport(double width, int imgWidth, double aspectRatio) : width(width) {
+    Viewport(Real width, int imgWidth, Real aspectRatio) : width(width) {
         this->width = width;
         this->height = width / aspectRatio;
 
         img = std::make_unique<Image>(imgWidth, static_cast<int>(std::round(imgWidth / aspectRatio)));
     }
     // Create a viewport by giving the dimensions of the viewport and image.
-    Viewport(double vpWidth, double vpHeight, int imgWidth, int imgHeight)
+    Viewport(Real vpWidth, Real vpHeight, int imgWidth, int imgHeight)
             : width(vpWidth), height(vpHeight) {
         img = std::make_unique<Image>(imgWidth, imgHeight);
     }
 
     // Get the location of the bottom left pixel of the viewport.
-    Pnt3 bottomLeft(Pnt3 camCenter, double focalLength) const;
+    Pnt3 bottomLeft(Pnt3 camCenter, Real focalLength) const;
 
     // Return a vector that represents the motion required to move across
     // pixel in the horizontal direction.
@@ -68,27 +91,44 @@ public:
     Vec3 dy() const;
 
     // Return a pointer to the image.
-    std::shared_ptr<Image> getImg() { return img; }
+    std::shared_ptr<Image> getImg() const { return img; }
 };
 
 class Camera {
 private:
     Viewport viewport;
+    // Camera-space to world-space. The columns are the right, up and backward
+    // directions of the camera and its position.
     Mat4 transform;
-    double focalLength;
+    Real focalLength;
+
+    // Precomputed for generateRay: the center of the bottom left pixel on the
+    // plane in focus, the steps to the next pixel to the right and up, and the
+    // lens radius along the right and up directions. A pinhole camera has no
+    // lens.
+    Pnt3 firstPixel;
+    Vec3 pixelRight, pixelUp;
+    Vec3 lensRight, lensUp;
+    bool pinhole = true;
+    int imgHeight;
 
     // Cast a ray and return the time that it took to hit an object. You must
     // also pass the transformation matrix of the object so that the rays are in
     // the same coordinate space.
-    double castRay(Ray &r, const Object &obj, const Mat4 &transform) const;
+    Real castRay(Ray &r, const Object &obj, const Mat4 &transform) const;
 
 public:
-    // Create a camera.
-    Camera(const Viewport &viewport, Pnt3 position, double focalLength)
-            : viewport(viewport), focalLength(focalLength) {
-        transform = Mat4::identity();
-        transform.translate(position);
-    }
+    // Create a pinhole camera at the given position that looks down -z, with
+    // the viewport focalLength in front of it.
+    Camera(const Viewport &viewport, Pnt3 position, Real focalLength);
+
+    // Create a camera at from that looks at to, turned so that up points toward
+    // the top of the image. vfov is the vertical field of view in degrees, and
+    // the viewport only sets the size of the image. With an aperture, the
+    // diameter of the lens, points at focusDistance from the camera are sharp
+    // and everything else is blurred; a focusDistance of zero focuses on to.
+    Camera(const Viewport &viewport, Pnt3 from, Pnt3 to, Vec3 up, Real vfov,
+           Real aperture = 0, Real focusDistance = 0);
 
     // Get the position of the camera in world-space.
     Pnt3 getPosition() const;
@@ -97,13 +137,133 @@ public:
     Viewport getViewport() const;
 
     // Get the focal length of the camera.
-    double getFocalLength() const;
+    Real getFocalLength() const;
+
+    // Return whether the camera has a lens, in which case generateRay needs a
+    // lens sample.
+    bool hasLens() const { return !pinhole; }
+
+    // Generate a ray through the pixel at the given row and col of the image.
+    // The jitter moves the ray within the pixel, and the lens sample picks
+    // where it leaves the lens. Pinhole cameras ignore the lens sample.
+    Ray generateRay(int row, int col, Point2 jitter, Point2 lens = {}) const;
+};
+
+// How the rays of a pixel sample are traced.
+//
+// RecursiveIntegrator: each hit is shaded as soon as it is found, and the reflection,
+// transmission and shadow rays it needs are cast one at a time.
+// WavefrontIntegrator: rays are traced a level of the tree at a time in large queues,
+// with each stage running over the whole queue. See Wavefront.
+enum IntegratorType {
+    RecursiveIntegrator,
+    WavefrontIntegrator,
+};
+
+// What the cost heatmap measures.
+//
+// TimeHeatmap: the time spent tracing each pixel.
+// RayHeatmap: the number of rays of every kind cast for each pixel.
+enum HeatmapMetric {
+    TimeHeatmap,
+    RayHeatmap,
+};
+
+// What a render with a crop window outputs.
+//
+// CompositeCrop: the whole image, with the window traced over what the image
+// already holds. If the output file exists and has the same dimensions, that
+// is what the image holds, so a region of a finished render can be traced
+// again with more samples. Otherwise pixels outside the window are left as
+// they were, which is transparent for an image that was never rendered.
+// CroppedImage: an image of just the window.
+enum CropMode {
+    CompositeCrop,
+    CroppedImage,
+};
+
+// Options that control how a scene is rendered.
+struct RenderSettings {
+    // The number of samples taken for each pixel.
+    unsigned samples;
+
+    // The sequence that generates the camera, light and BSDF samples.
+    SamplerType sampler = SamplerType::Sobol;
+
+    // The integrator that traces the samples.
+    IntegratorType integrator = RecursiveIntegrator;
+
+    // Sort each level of reflection and transmission rays by direction octant
+    // and origin Morton code before tracing it, so that neighbouring rays
+    // touch the same parts of the scene. Only used by the wavefront
+    // integrator, which has the rays of a level queued together.
+    bool sortRays = false;
+
+    // Seed for the sampler. Renders with the same seed are identical.
+    uint32_t seed = 0;
+
+    // Adaptive sampling stops sampling pixels whose relative error drops below
+    // this threshold and spends the samples it saves on noisier pixels. The
+    // total number of samples never exceeds samples x pixels. Zero disables
+    // adaptive sampling.
+    double adaptiveThreshold = 0;
+
+    // The number of samples every pixel receives before its error estimate is
+    // trusted by adaptive sampling.
+    unsigned minSamples = 4;
+
+    // The most samples that adaptive sampling will spend on a single pixel.
+    unsigned maxSamples = 64;
+
+    // Progressive rendering stops once this many seconds have passed, even if
+    // fewer than `samples` passes are done. Zero means no deadline.
+    double timeBudget = 0;
+
+    // How often progressive rendering writes its current estimate to disk, in
+    // seconds. Zero only writes the final image.
+    double flushInterval = 0;
+
+    // Where progressive rendering keeps its checkpoint. If the file exists when
+    // the render starts, the render resumes from it. Empty disables
+    // checkpointing.
+    std::string checkpointPath;
+
+    // How often progressive rendering saves a checkpoint, in seconds. A
+    // checkpoint is also saved when the time budget runs out, and deleted once
+    // the render completes.
+    double checkpointInterval = 60;
+
+    // Where to write a Chrome trace of the render, showing every pass, tile
+    // and image save on the thread that did it. Recording starts with the
+    // render unless timeline::start was called earlier, for example to
+    // include building the scene. Empty disables the trace.
+    std::string timelinePath;
+
+    // Where to save a false-color image of what each pixel cost to render,
+    // which shows the parts of a scene worth simplifying. Empty disables it.
+    std::string heatmapPath;
+
+    // What the heatmap measures.
+    HeatmapMetric heatmapMetric = TimeHeatmap;
+
+    // The window of the image to trace, clipped to the image. Pixels outside
+    // it cost nothing. An empty window traces the whole image; renders with a
+    // window that lies outside the image fail.
+    Tile crop{0, 0, 0, 0};
+
+    // What a render with a crop window outputs.
+    CropMode cropMode = CompositeCrop;
+
+    RenderSettings(unsigned samples = 1) : samples(samples) {}
 };
 
 class Scene {
 private:
     // Contains all of the objects in the scene.
-    std::vector<std::shared_ptr<Object>> objs;
+    Primitives primitives;
+
+    // Contains the materials that the objects refer to.
+    MaterialTable materials;
 
     // Contains all of the lights in the scene.
     std::vector<std::shared_ptr<Light>> lights;
@@ -114,38 +274,187 @@ private:
     // Helper for the shade function. Compute the lighting at a particular point.
     // All arguments must be in world space.
     Color lighting(const Pnt3 &point, const Vec3 &viewDirection,
-                 const Vec3 &normal, const std::shared_ptr<Material> &material,
-                 unsigned char samples) const;
+                 const Vec3 &normal, const Material &material,
+                 unsigned char samples, Sampler &sampler) const;
 
     // Helper for the shade function. Compute the reflection color at a
     // particular point. All arguments must be in world space.
     Color reflection(const Pnt3 &point, const Vec3 &viewDirection,
                    const Vec3 &normal,
-                   const std::shared_ptr<Material> &material,
-                   unsigned char depth, const unsigned char maxDepth) const;
+                   const Material &material,
+                   unsigned char depth, const unsigned char maxDepth,
+                   Sampler &sampler) const;
 
     // Helper for the shade function. Compute the transmission color at a
     // particular point. All arguments must be in world space.
     Color transmission(const Pnt3 &point, Vec3 &viewDirection, Vec3 &normal,
-                     const std::shared_ptr<Material> &material, const double ki,
-                     const double kt, unsigned char depth,
-                     const unsigned char maxDepth) const;
+                     const Material &material, const Real ki,
+                     const Real kt, unsigned char depth,
+                     const unsigned char maxDepth, Sampler &sampler) const;
 
     // Compute the color of a hit.
-    Color shade(std::unique_ptr<Hit> hit, unsigned char depth) const;
+    Color shade(const Hit &hit, unsigned char depth,
+                Sampler &sampler) const;
+
+    // Trace every pixel of the crop window into the image. The image must have
+    // the dimensions of the output; see outputSize.
+    void trace(Image &img, const RenderSettings &settings) const;
+
+    // Return whether the settings ask for a crop window.
+    static bool hasCrop(const RenderSettings &settings);
+
+    // Return the part of the image that the settings ask to trace.
+    Tile cropWindow(const RenderSettings &settings) const;
+
+    // Print an error and return false if the crop window of the settings lies
+    // outside the image, which leaves nothing to trace.
+    bool checkCropWindow(const RenderSettings &settings) const;
+
+    // Before a crop window is composited into img, load the image that is
+    // already at path into it, if there is one.
+    void loadComposite(Image &img, const std::string &path,
+                       const RenderSettings &settings) const;
+
+    // Write the film into the output image, where the crop mode puts it.
+    void resolve(const Film &film, Image &img, const RenderSettings &settings) const;
+
+    // Save the heatmap of the film's costs if the settings ask for one.
+    void saveHeatmap(const Film &film, const RenderSettings &settings) const;
+
+    // Trace the given number of samples of a pixel and add them to the film.
+    // Sample indices continue from the samples already on the film.
+    void tracePixel(Film &film, int row, int col, unsigned count,
+                    Sampler &sampler) const;
+
+    // Trace count[row * width + col] samples for every pixel of the film. The
+    // work is split into tiles that are rendered in parallel. Tiles that have
+    // not been started by the deadline are skipped.
+    void traceTiles(Film &film, const std::vector<unsigned> &count,
+                    const RenderSettings &settings,
+                    std::chrono::steady_clock::time_point deadline =
+                            std::chrono::steady_clock::time_point::max()) const;
+
+    // The width and height of the tiles that are handed to each thread.
+    static const int TILE_SIZE = 32;
+
+    // The width and height of the tiles that are handed to each worker
+    // process, which splits them again for its threads.
+    static const int JOB_SIZE = 128;
+
+    // The number of compact rays that intersect moves through the scene
+    // together. Small enough for the chunk and its scratch arrays to stay in
+    // the L1 and L2 caches.
+    static constexpr size_t INTERSECT_CHUNK = 256;
 
     // The amount to shift a ray by to avoid self-intersection.
     static float BIAS;
 
+    friend class Wavefront;
+
 public:
-    // Create a scene with a list of objects, a list of lights, and a camera.
-    Scene(std::vector<std::shared_ptr<Object>> &objs,
+    // Create a scene with a list of objects, the table of materials they refer
+    // to, a list of lights, and a camera. The geometry of each object is copied
+    // into the scene.
+    Scene(std::vector<std::shared_ptr<Object>> &objs, MaterialTable &materials,
                 std::vector<std::shared_ptr<Light>> &lights, Camera &cam)
-            : objs(std::move(objs)), lights(std::move(lights)), cam(cam) {}
+            : materials(std::move(materials)), lights(std::move(lights)), cam(cam) {
+        stats::PhaseTimer timer(stats::SceneBuild);
+        timeline::Scope scope("scene setup");
+        for (const auto &obj : objs) primitives.add(*obj);
+        objs.clear();
+    }
 
-    // Cast a ray onto every object in the scene and return a hit.
-    std::optional<std::unique_ptr<Hit>> castRay(Ray &r) const;
+    // Create a scene from primitives that are already stored by type.
+    Scene(Primitives &primitives, MaterialTable &materials,
+                std::vector<std::shared_ptr<Light>> &lights, Camera &cam)
+            : primitives(std::move(primitives)), materials(std::move(materials)),
+              lights(std::move(lights)), cam(cam) {}
+
+    // Return the camera the scene is rendered with.
+    const Camera &getCamera() const { return cam; }
+
+    // Render the scene with another camera from now on.
+    void setCamera(const Camera &camera) { cam = camera; }
 
-    // Render the scene and save it as a PNG file.
-    void render(const std::string &path, unsigned samples);
+    // Move a primitive by giving it a new object to world transform. Objects
+    // get the handles {SpherePrimitive, i} in the order they were passed in.
+    void setTransform(PrimitiveHandle handle, const Mat4 &transform) {
+        primitives.setTransform(handle, transform);
+    }
+
+    // Cast a ray onto every object in the scene and return a hit.
+    std::optional<Hit> castRay(Ray &r) const;
+
+    // Cast every ray of a stream onto every object in the scene and return a
+    // hit for each one. The whole stream is moved into each object's space and
+    // intersected with it at once. Gives the same hits as calling castRay on
+    // each ray. The hits and the scratch space used to find them are allocated
+    // from the arena and stay valid until it is reset.
+    std::span<const std::optional<Hit>> castRays(const RayStream &rays, Arena &arena) const;
+
+    // Find the closest hit of every compact ray and store its t and primitive
+    // in the hit at the same index. Meant for batches of millions of rays: they
+    // are intersected in single precision, a chunk at a time, with each chunk
+    // moved into every object's space at once. Scratch space comes from the
+    // arena.
+    void intersect(std::span<const CompactRay> rays, std::span<CompactHit> hits,
+                   Arena &arena) const;
+
+    // Find the closest hit of every ray of a stream in double precision and
+    // store its t and packed primitive at the same index, or CompactHit::NONE
+    // if the ray hits nothing. Gives the same hits as castRay, a chunk of rays
+    // at a time like the compact version.
+    void intersect(const RayStream &rays, std::span<Real> t, std::span<std::uint32_t> primitive,
+                   Arena &arena) const;
+
+    // Fill in the surface coordinates of hits found by intersect. This is a
+    // separate pass because the trigonometry costs about as much as finding the
+    // hits, and only stages that look up textures need it.
+    void surfaceCoords(std::span<const CompactRay> rays, std::span<CompactHit> hits) const;
+
+    // Return the width and height of the image a render with the settings
+    // outputs, which is the crop window for CroppedImage and the viewport
+    // otherwise.
+    std::pair<int, int> outputSize(const RenderSettings &settings) const;
+
+    // Render the scene and save it as a PNG file. When statistics are compiled
+    // in, they are printed as JSON once the image is saved. Returns false if
+    // the image could not be rendered or saved.
+    bool render(const std::string &path, const RenderSettings &settings);
+
+    // Render the scene into the writer's back buffer and queue it to be saved
+    // as a PNG file. Returns as soon as tracing is done, so the next frame can
+    // start while this one is being encoded. The writer's framebuffers must
+    // have the dimensions of the output, which is the crop window when only
+    // the window is output. Saving a timeline waits for the encode as well.
+    void render(const std::string &path, const RenderSettings &settings,
+                ImageWriter &writer);
+
+    // Render the scene in passes of one sample per pixel until `samples` passes
+    // are done or the time budget runs out, whichever comes first. The current
+    // estimate is saved every flush interval and once more at the end, so the
+    // file at path always holds the best image so far. With adaptive sampling
+    // enabled, converged pixels are skipped by later passes. A render that is
+    // resumed from a checkpoint produces the same image as one that wasn't
+    // interrupted.
+    void renderProgressive(const std::string &path,
+                           const RenderSettings &settings);
+
+    // Render the scene with worker processes and save it as a PNG file. Listens
+    // on the address (see distributed.h) and hands tiles to every worker that
+    // connects, as many at once as connect, until the image is done. Workers
+    // can connect at any time; the tiles of a worker that is lost are traced
+    // by the others. Returns false if the image could not be finished, which
+    // includes no worker being connected for 30 seconds. Every pixel gets the
+    // full sample count: adaptive sampling, the heatmap and the timeline are
+    // local to a process and not used.
+    bool renderDistributed(const std::string &path, const RenderSettings &settings,
+                           const std::string &address);
+
+    // Connect to a coordinator at the address and trace the tiles it hands
+    // out with all of this machine's threads, until it says the image is done.
+    // The scene must be built the same way as the coordinator's, which is
+    // checked as far as the image size and object and light counts go.
+    // Returns false if the connection failed.
+    bool serveTiles(const std::string &address);
 };
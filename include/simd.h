@@ -0,0 +1,155 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#if defined(__SSE__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+namespace simd {
+
+// Whether Vec3T, Pnt3T and ColorT are padded to four lanes and do their
+// arithmetic on Pack4. Define RAYTRACER_SIMD to enable it. The padding makes
+// every vector a third larger, which only pays off when a pack of T fits a
+// native register: float with SSE or double with AVX.
+#ifdef RAYTRACER_SIMD
+inline constexpr bool ENABLED = true;
+#else
+inline constexpr bool ENABLED = false;
+#endif
+
+// The alignment of types that are loaded into a Pack4<T>.
+template <typename T>
+inline constexpr std::size_t ALIGNMENT = ENABLED ? 4 * sizeof(T) : alignof(T);
+
+// Four lanes of T that are operated on together. Pack4<float> maps onto an SSE
+// register and Pack4<double> onto an AVX register when the target supports
+// them. Otherwise the lanes are plain scalars that are operated on one at a
+// time.
+template <typename T>
+struct Pack4 {
+    T a, b, c, d;
+
+    // Load four consecutive values.
+    static Pack4 load(const T *p) { return Pack4{p[0], p[1], p[2], p[3]}; }
+
+    // Store the lanes to four consecutive values.
+    void store(T *p) const {
+        p[0] = a;
+        p[1] = b;
+        p[2] = c;
+        p[3] = d;
+    }
+
+    // Return a pack with every lane set to s.
+    static Pack4 broadcast(T s) { return Pack4{s, s, s, s}; }
+
+    // Return the sum of the lanes.
+    T sum() const { return (a + b) + (c + d); }
+
+    // Return a pack whose lanes hold the sums of the lanes of p, q, r and s.
+    static Pack4 sums(Pack4 p, Pack4 q, Pack4 r, Pack4 s) {
+        return Pack4{p.sum(), q.sum(), r.sum(), s.sum()};
+    }
+
+    friend Pack4 operator+(Pack4 p, Pack4 q) { return Pack4{p.a + q.a, p.b + q.b, p.c + q.c, p.d + q.d}; }
+    friend Pack4 operator-(Pack4 p, Pack4 q) { return Pack4{p.a - q.a, p.b - q.b, p.c - q.c, p.d - q.d}; }
+    friend Pack4 operator*(Pack4 p, Pack4 q) { return Pack4{p.a * q.a, p.b * q.b, p.c * q.c, p.d * q.d}; }
+    friend Pack4 operator/(Pack4 p, Pack4 q) { return Pack4{p.a / q.a, p.b / q.b, p.c / q.c, p.d / q.d}; }
+    friend Pack4 min(Pack4 p, Pack4 q) {
+        return Pack4{std::min(p.a, q.a), std::min(p.b, q.b), std::min(p.c, q.c), std::min(p.d, q.d)};
+    }
+    friend Pack4 max(Pack4 p, Pack4 q) {
+        return Pack4{std::max(p.a, q.a), std::max(p.b, q.b), std::max(p.c, q.c), std::max(p.d, q.d)};
+    }
+
+    // Return p * q + r.
+    friend Pack4 fmadd(Pack4 p, Pack4 q, Pack4 r) { return p * q + r; }
+};
+
+#ifdef __SSE__
+template <>
+struct Pack4<float> {
+    __m128 v;
+
+    static Pack4 load(const float *p) { return Pack4{_mm_loadu_ps(p)}; }
+
+    void store(float *p) const { _mm_storeu_ps(p, v); }
+
+    static Pack4 broadcast(float s) { return Pack4{_mm_set1_ps(s)}; }
+
+    float sum() const {
+        __m128 shuffled = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+        __m128 pairs = _mm_add_ps(v, shuffled);
+        shuffled = _mm_movehl_ps(shuffled, pairs);
+        return _mm_cvtss_f32(_mm_add_ss(pairs, shuffled));
+    }
+
+    static Pack4 sums(Pack4 a, Pack4 b, Pack4 c, Pack4 d) {
+        _MM_TRANSPOSE4_PS(a.v, b.v, c.v, d.v);
+        return Pack4{_mm_add_ps(_mm_add_ps(a.v, b.v), _mm_add_ps(c.v, d.v))};
+    }
+
+    friend Pack4 operator+(Pack4 a, Pack4 b) { return Pack4{_mm_add_ps(a.v, b.v)}; }
+    friend Pack4 operator-(Pack4 a, Pack4 b) { return Pack4{_mm_sub_ps(a.v, b.v)}; }
+    friend Pack4 operator*(Pack4 a, Pack4 b) { return Pack4{_mm_mul_ps(a.v, b.v)}; }
+    friend Pack4 operator/(Pack4 a, Pack4 b) { return Pack4{_mm_div_ps(a.v, b.v)}; }
+    friend Pack4 min(Pack4 a, Pack4 b) { return Pack4{_mm_min_ps(a.v, b.v)}; }
+    friend Pack4 max(Pack4 a, Pack4 b) { return Pack4{_mm_max_ps(a.v, b.v)}; }
+
+    friend Pack4 fmadd(Pack4 a, Pack4 b, Pack4 c) {
+#ifdef __FMA__
+        return Pack4{_mm_fmadd_ps(a.v, b.v, c.v)};
+#else
+        return a * b + c;
+#endif
+    }
+};
+#endif
+
+#ifdef __AVX__
+template <>
+struct Pack4<double> {
+    __m256d v;
+
+    static Pack4 load(const double *p) { return Pack4{_mm256_loadu_pd(p)}; }
+
+    void store(double *p) const { _mm256_storeu_pd(p, v); }
+
+    static Pack4 broadcast(double s) { return Pack4{_mm256_set1_pd(s)}; }
+
+    double sum() const {
+        __m128d low = _mm256_castpd256_pd128(v);
+        __m128d high = _mm256_extractf128_pd(v, 1);
+        low = _mm_add_pd(low, high);
+        high = _mm_unpackhi_pd(low, low);
+        return _mm_cvtsd_f64(_mm_add_sd(low, high));
+    }
+
+    static Pack4 sums(Pack4 a, Pack4 b, Pack4 c, Pack4 d) {
+        // Each hadd sums neighbouring lanes within the two 128-bit halves.
+        __m256d ab = _mm256_hadd_pd(a.v, b.v);
+        __m256d cd = _mm256_hadd_pd(c.v, d.v);
+        __m256d low = _mm256_permute2f128_pd(ab, cd, 0x20);
+        __m256d high = _mm256_permute2f128_pd(ab, cd, 0x31);
+        return Pack4{_mm256_add_pd(low, high)};
+    }
+
+    friend Pack4 operator+(Pack4 a, Pack4 b) { return Pack4{_mm256_add_pd(a.v, b.v)}; }
+    friend Pack4 operator-(Pack4 a, Pack4 b) { return Pack4{_mm256_sub_pd(a.v, b.v)}; }
+    friend Pack4 operator*(Pack4 a, Pack4 b) { return Pack4{_mm256_mul_pd(a.v, b.v)}; }
+    friend Pack4 operator/(Pack4 a, Pack4 b) { return Pack4{_mm256_div_pd(a.v, b.v)}; }
+    friend Pack4 min(Pack4 a, Pack4 b) { return Pack4{_mm256_min_pd(a.v, b.v)}; }
+    friend Pack4 max(Pack4 a, Pack4 b) { return Pack4{_mm256_max_pd(a.v, b.v)}; }
+
+    friend Pack4 fmadd(Pack4 a, Pack4 b, Pack4 c) {
+#ifdef __FMA__
+        return Pack4{_mm256_fmadd_pd(a.v, b.v, c.v)};
+#else
+        return a * b + c;
+#endif
+    }
+};
+#endif
+
+}  // namespace simd
@@ -0,0 +1,100 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include "object.h"
+
+// Counters for the rays a frame traces and the time it spends in each phase.
+// Each thread counts into its own copy, which is added to the frame totals
+// when the thread finishes a tile, so counting never touches shared memory.
+namespace stats {
+
+// Whether the renderer keeps statistics. Define RAYTRACER_STATS to enable it.
+// When it is disabled every call below compiles to nothing.
+#ifdef RAYTRACER_STATS
+inline constexpr bool ENABLED = true;
+#else
+inline constexpr bool ENABLED = false;
+#endif
+
+// The events that are counted.
+enum Counter {
+    PrimaryRays,
+    ShadowRays,
+    ReflectionRays,
+    RefractionRays,
+    // Ray-primitive intersection tests.
+    IntersectionTests,
+    // Ray-primitive tests that were skipped because a whole chunk of rays
+    // pointed away from the primitive.
+    CulledTests,
+    COUNTERS,
+};
+
+// The phases of a frame that are timed.
+enum Phase {
+    SceneBuild,
+    Trace,
+    Encode,
+    PHASES,
+};
+
+// The statistics of a thread or of a whole frame.
+struct Counters {
+    std::array<uint64_t, COUNTERS> events{};
+    std::array<uint64_t, MATERIAL_TYPES> shadingCalls{};
+    std::array<double, PHASES> seconds{};
+
+    // Add another set of statistics to this one.
+    void merge(const Counters &other);
+
+    // Return the statistics as a JSON object.
+    std::string toJson() const;
+};
+
+// Return the statistics of the calling thread.
+inline Counters &local() {
+    thread_local Counters counters;
+    return counters;
+}
+
+// Add n events to a counter of the calling thread.
+inline void count(Counter counter, uint64_t n = 1) {
+    if constexpr (ENABLED) local().events[counter] += n;
+}
+
+// Count a call to shade a hit with a material of the given type.
+inline void countShading(MaterialType type) {
+    if constexpr (ENABLED) local().shadingCalls[type]++;
+}
+
+// Add the statistics of the calling thread to the frame totals and clear them.
+void flush();
+
+// Flush the calling thread, then return the frame totals and clear them.
+Counters collect();
+
+// Adds the time from its construction to its destruction to a phase of the
+// calling thread.
+class PhaseTimer {
+private:
+    Phase phase;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit PhaseTimer(Phase phase) : phase(phase) {
+        if constexpr (ENABLED) start = std::chrono::steady_clock::now();
+    }
+
+    ~PhaseTimer() {
+        if constexpr (ENABLED) {
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            local().seconds[phase] += elapsed.count();
+        }
+    }
+
+    PhaseTimer(const PhaseTimer &) = delete;
+    PhaseTimer &operator=(const PhaseTimer &) = delete;
+};
+}  // namespace stats
@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Records when each thread starts and finishes the parts of a render, such as
+// tiles, passes and encoding, and exports them in the Chrome trace event
+// format. Load the file in chrome://tracing or ui.perfetto.dev to see how
+// evenly the tiles were spread over the threads and where they sat idle.
+//
+// Every thread records into a ring buffer of its own, so recording an event
+// takes no lock and never allocates. Threads are given a lane the first time
+// they record and hand it back when they exit; the next thread to record
+// reuses it, so the workers of successive passes share lanes and their events
+// outlive them. When a lane is full its oldest events are overwritten.
+namespace timeline {
+
+namespace detail {
+extern std::atomic<bool> recording;
+
+// Add a finished event to the lane of the calling thread.
+void record(const char *name, const char *argName, int64_t arg,
+            std::chrono::steady_clock::time_point start,
+            std::chrono::steady_clock::time_point end);
+}  // namespace detail
+
+// The number of events each lane keeps.
+inline constexpr size_t LANE_CAPACITY = 1 << 16;
+
+// Return whether events are being recorded.
+inline bool recording() { return detail::recording.load(std::memory_order_relaxed); }
+
+// Throw away the events recorded so far and start recording. Time in the
+// trace is measured from this call.
+void start();
+
+// Stop recording and write every recorded event to path as a Chrome trace.
+// Must not be called while other threads are recording. Returns false if the
+// file could not be written.
+bool stop(const std::string &path);
+
+// Records an event that lasts from its construction to its destruction. The
+// name and argument name must outlive the trace; string literals are meant.
+// Does nothing but check a flag when the timeline isn't recording.
+class Scope {
+private:
+    const char *name;
+    const char *argName;
+    int64_t arg;
+    bool active;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    // Record an event with a single integer argument, shown when the event is
+    // selected in the viewer. A null argName records no argument.
+    explicit Scope(const char *name, const char *argName = nullptr, int64_t arg = 0)
+            : name(name), argName(argName), arg(arg), active(recording()) {
+        if (active) start = std::chrono::steady_clock::now();
+    }
+
+    ~Scope() {
+        if (active) {
+            detail::record(name, argName, arg, start, std::chrono::steady_clock::now());
+        }
+    }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+};
+}  // namespace timeline
@@ -1,20 +1,48 @@
+#pragma once
+#include <atomic>
+#include <functional>
 #include <random>
+#include <thread>
+#include <vector>
 #include "object.h"
 
 namespace utils {
 static std::mt19937 gen;
-static std::uniform_real_distribution<double> distribution(0.0, 1.0);
+static std::uniform_real_distribution<Real> distribution(0.0, 1.0);
 
 // Compute the color produced by the Blinn-Phong illumination model for this
 // object.
-Color phong(const std::shared_ptr<Material> &object, 
+Color phong(const Material &material,
     const std::shared_ptr<Light> &light, const Vec3 &L, const Vec3 &V, const Vec3 &N);
 
-double fresnel(double cosTheta, double indexOfRefraction);
+Real fresnel(Real cosTheta, Real indexOfRefraction);
 
 // Generate a random number in the given range.
-double random(double min, double max);
+Real random(Real min, Real max);
 
 // Generate a random number between 0 and 1.
-double random();
+Real random();
+
+// Call job on the calling thread and on up to helpers threads of a pool that
+// lives as long as the program, and return once every call has returned. The
+// pool threads keep their thread_local state, such as Arena::local(), from
+// one call to the next. Called from within a job, it runs the new job on the
+// calling thread alone.
+void runOnPool(int helpers, const std::function<void()> &job);
+
+// Call task(i) for every i in [0, count) using all of the hardware threads.
+// Indices are handed out one at a time, so expensive tasks don't hold up the
+// cheap ones.
+template <typename Task>
+void parallelFor(int count, Task &&task) {
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, count);
+
+    std::atomic<int> next{0};
+    runOnPool(threads - 1, [&]() {
+        for (int i = next++; i < count; i = next++) {
+            task(i);
+        }
+    });
+}
 }
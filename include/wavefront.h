@@ -0,0 +1,142 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "scene.h"
+
+// Traces the same tree of rays as Scene::shade, but breadth first: the
+// vertices at one depth go through each stage together before the vertices
+// they spawn are looked at. The stages are
+//
+//   generate   camera rays for a batch of pixel samples
+//   sort       optionally, reorder the secondary rays of a level for coherence
+//   intersect  the closest hit of every ray of a level, a chunk at a time
+//   shade      local lighting in order of material, queueing the shadow rays
+//              and the reflection and transmission rays of the next level
+//   shadows    intersect the shadow rays and add up the light that gets through
+//
+// Every queue is a structure of arrays, so each stage is a loop over plain
+// arrays of numbers. A level is shaded a chunk at a time, and the levels below
+// a chunk are finished and added into it before the next chunk is shaded,
+// which bounds the size of the queues however much a path branches.
+//
+// The samples of a vertex come from dimensions picked by its position in the
+// tree rather than by the order the recursion reaches it in, so the image has
+// the same expected value as the recursive one but different noise.
+//
+// The queues grow to what a batch needs and are then reused, so a thread
+// should keep one Wavefront for all of its tiles.
+class Wavefront {
+private:
+    // One camera sample of the batch, at a row and col of the film.
+    struct PixelSample {
+        int row, col;
+        unsigned index;
+    };
+
+    // The vertices at one depth of the tree. Vertex i is where ray i ends.
+    struct Level {
+        RayStream rays;
+        std::vector<std::uint32_t> sample;  // camera sample the vertex belongs to
+        std::vector<std::uint32_t> parent;  // vertex one level up that spawned it
+        std::vector<std::uint32_t> path;    // position in the tree, picks its dimensions
+        std::vector<Color> weight;          // scales its color when added to the parent
+
+        // Filled in by the stages.
+        std::vector<Real> t;
+        std::vector<std::uint32_t> primitive;
+        std::vector<Color> color;     // light leaving the vertex towards its parent
+        std::vector<Color> children;  // weighted colors of the vertices it spawned
+
+        size_t size() const { return sample.size(); }
+
+        // Remove every vertex, keeping the capacity.
+        void clear();
+
+        // Queue a ray whose hit will become a vertex of this level.
+        void push(const Ray &ray, std::uint32_t sample, std::uint32_t parent, std::uint32_t path,
+                  const Color &weight);
+    };
+
+    // Shadow rays of the chunk that is being shaded. Each one goes to one
+    // sample of one light at one vertex.
+    struct ShadowQueue {
+        RayStream rays;
+        std::vector<std::uint32_t> slot;  // vertex * lights + light, relative to the chunk
+        std::vector<Real> distance;       // to the point sampled on the light
+        std::vector<Color> light;         // reflected light if nothing is in the way
+        std::vector<Real> t;
+        std::vector<std::uint32_t> primitive;
+        std::vector<Real> blocked;        // 1 if something is in the way, else 0
+
+        // Remove every ray, keeping the capacity.
+        void clear();
+    };
+
+    std::vector<PixelSample> samples;
+    std::vector<Level> levels;
+    ShadowQueue shadows;
+
+    // Per light sums of the shadow rays of the chunk, indexed like the slots.
+    std::vector<Color> lightSum;
+    std::vector<unsigned> blockedCount;
+
+    // Vertex indices of the chunk, sorted by material, and the bucket offsets
+    // used to sort them.
+    std::vector<std::uint32_t> order;
+    std::vector<std::uint32_t> offsets;
+
+    // The rays cast for each camera sample of the batch, for the heatmap.
+    std::vector<std::uint32_t> sampleRays;
+
+    // The settings of the render being traced.
+    const RenderSettings *settings = nullptr;
+
+    // The column and row of the image where the film being traced starts.
+    // Samples are generated for pixels of the image, not of the film.
+    int left = 0, top = 0;
+
+    // The sort keys of a level and the level they are gathered into.
+    std::vector<std::uint64_t> keys;
+    Level sorted;
+
+    // Create camera rays for the batch of samples.
+    void generate(const Scene &scene, Sampler &sampler);
+
+    // Reorder the rays of a level by the octant of their direction and the
+    // Morton code of their origin, so that rays that are intersected and
+    // shaded together start close to each other and go the same way.
+    void sortLevel(unsigned depth);
+
+    // Trace every vertex of a level and everything it spawns.
+    void traceLevel(const Scene &scene, unsigned depth, Sampler &sampler);
+
+    // Compute the direct lighting of vertices [first, last) of a level and
+    // queue their shadow rays and the rays of the next level.
+    void shade(const Scene &scene, unsigned depth, size_t first, size_t last, Sampler &sampler);
+
+    // Intersect the queued shadow rays and add the light that reaches each
+    // vertex of [first, last) to its color.
+    void traceShadows(const Scene &scene, unsigned depth, size_t first, size_t last);
+
+    // Add the clamped colors of a level to the vertices that spawned them.
+    void gather(unsigned depth);
+
+    // Trace the samples of the batch and add them to the film.
+    void traceBatch(const Scene &scene, Film &film, Sampler &sampler);
+
+public:
+    // The number of vertices that are shaded together, and the number of
+    // camera rays in a batch.
+    static const size_t CHUNK_SIZE = 4096;
+
+    Wavefront();
+
+    // Trace count[row * width + col] samples of every pixel in the tile and
+    // add them to the film. Sample indices continue from the samples already
+    // on the film. Rays are sorted and costs recorded as the settings ask.
+    // Pixels are traced together, so the time heatmap splits the time of a
+    // batch between its pixels by the rays each one cast.
+    void trace(const Scene &scene, Film &film, const Tile &tile,
+               const std::vector<unsigned> &count, Sampler &sampler,
+               const RenderSettings &settings);
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "scene.h"
+
+// Encodes and saves images on a background thread so that the next frame can
+// be traced while the previous one is being written. The writer owns two
+// framebuffers: the renderer draws into the back buffer while the encoder
+// works on the front buffer, and the two are swapped on every submit.
+class ImageWriter {
+private:
+    // A frame that is waiting to be encoded.
+    struct Job {
+        int buffer;
+        std::string path;
+    };
+
+    Image buffers[2];
+    bool busy[2] = {false, false};
+    int back = 0;
+
+    std::deque<Job> jobs;
+    bool stopping = false;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::thread worker;
+
+    // Body of the encoder thread.
+    void run();
+
+public:
+    // Create a writer whose framebuffers have the given dimensions.
+    ImageWriter(int width, int height);
+
+    // Flushes any pending frames before returning.
+    ~ImageWriter();
+
+    ImageWriter(const ImageWriter &) = delete;
+    ImageWriter &operator=(const ImageWriter &) = delete;
+
+    // Return the framebuffer that the next frame should be rendered into. Blocks
+    // if the encoder is still reading from it.
+    Image &acquire();
+
+    // Hand the back buffer to the encoder thread to be saved at the given path
+    // and swap buffers. Returns immediately.
+    void submit(const std::string &path);
+
+    // Block until every submitted frame has been written.
+    void flush();
+};
@@ -0,0 +1,115 @@
+#include "animation.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <tuple>
+#include "writer.h"
+
+namespace {
+// Return the keys around a time and how far the time is from the first to the
+// second. Both are the same key outside the range of the keys.
+template <typename Key>
+std::tuple<const Key &, const Key &, Real> around(const std::vector<Key> &keys, double time) {
+    auto next = std::upper_bound(keys.begin(), keys.end(), time,
+                                 [](double t, const Key &key) { return t < key.time; });
+    if (next == keys.begin()) return {keys.front(), keys.front(), 0};
+    if (next == keys.end()) return {keys.back(), keys.back(), 0};
+    const Key &previous = *(next - 1);
+    Real t = static_cast<Real>((time - previous.time) / (next->time - previous.time));
+    return {previous, *next, t};
+}
+
+template <typename T>
+T lerp(const T &a, const T &b, Real t) {
+    return a * (1 - t) + b * t;
+}
+
+Pnt3 lerp(const Pnt3 &a, const Pnt3 &b, Real t) { return a + (b - a) * t; }
+
+template <typename Key>
+void insertSorted(std::vector<Key> &keys, const Key &key) {
+    auto position = std::upper_bound(keys.begin(), keys.end(), key.time,
+                                     [](double t, const Key &k) { return t < k.time; });
+    keys.insert(position, key);
+}
+
+// Replace the first run of '#' in the pattern with the zero padded frame.
+std::string framePath(const std::string &pattern, int frame) {
+    size_t first = pattern.find('#');
+    if (first == std::string::npos) return pattern;
+    size_t last = pattern.find_first_not_of('#', first);
+    size_t width = (last == std::string::npos ? pattern.size() : last) - first;
+    std::string number = std::to_string(frame);
+    if (number.size() < width) number.insert(0, width - number.size(), '0');
+    return pattern.substr(0, first) + number + pattern.substr(first + width);
+}
+}  // namespace
+
+void Animation::addCameraKey(const CameraKey &key) { insertSorted(cameraKeys, key); }
+
+void Animation::addObjectKey(PrimitiveHandle object, const ObjectKey &key) {
+    auto track = std::find_if(objectTracks.begin(), objectTracks.end(), [&](const auto &t) {
+        return t.first.pack() == object.pack();
+    });
+    if (track == objectTracks.end()) {
+        objectTracks.emplace_back(object, std::vector<ObjectKey>{});
+        track = objectTracks.end() - 1;
+    }
+    insertSorted(track->second, key);
+}
+
+Camera Animation::cameraAt(const Viewport &viewport, double time) const {
+    auto [a, b, t] = around(cameraKeys, time);
+    return Camera(viewport, lerp(a.from, b.from, t), lerp(a.to, b.to, t), lerp(a.up, b.up, t),
+                  lerp(a.fov, b.fov, t), lerp(a.aperture, b.aperture, t),
+                  lerp(a.focusDistance, b.focusDistance, t));
+}
+
+std::vector<FrameTiming> Animation::render(Scene &scene, const std::string &pattern, int frames,
+                                           double fps, const RenderSettings &settings) const {
+    using Clock = std::chrono::steady_clock;
+
+    // Scene::render would save the timeline after every frame.
+    RenderSettings frameSettings = settings;
+    frameSettings.timelinePath.clear();
+    bool timeline = !settings.timelinePath.empty();
+    if (timeline && !timeline::recording()) timeline::start();
+
+    Viewport viewport = scene.getCamera().getViewport();
+    auto [width, height] = scene.outputSize(settings);
+    ImageWriter writer(width, height);
+    std::vector<FrameTiming> timings;
+    for (int frame = 0; frame < frames; ++frame) {
+        timeline::Scope scope("frame", "frame", frame);
+        double time = frame / fps;
+
+        Clock::time_point start = Clock::now();
+        if (!cameraKeys.empty()) scene.setCamera(cameraAt(viewport, time));
+        for (const auto &[object, keys] : objectTracks) {
+            auto [a, b, t] = around(keys, time);
+            Mat4 transform = Mat4::identity();
+            transform.scale(lerp(a.scale, b.scale, t));
+            transform.translate(lerp(a.position, b.position, t));
+            scene.setTransform(object, transform);
+        }
+        Clock::time_point ready = Clock::now();
+        scene.render(framePath(pattern, frame), frameSettings, writer);
+        Clock::time_point end = Clock::now();
+
+        FrameTiming timing{std::chrono::duration<double>(ready - start).count(),
+                           std::chrono::duration<double>(end - ready).count()};
+        timings.push_back(timing);
+        std::cout << "Frame " << frame << ": " << std::fixed << std::setprecision(3)
+                  << timing.setup * 1e3 << " ms setup, " << timing.trace << " s trace"
+                  << std::defaultfloat << std::endl;
+    }
+
+    Clock::time_point start = Clock::now();
+    writer.flush();
+    std::cout << "Last frame encoded " << std::fixed << std::setprecision(3)
+              << std::chrono::duration<double>(Clock::now() - start).count()
+              << " s after tracing finished" << std::defaultfloat << std::endl;
+
+    if (timeline) timeline::stop(settings.timelinePath);
+    return timings;
+}
@@ -0,0 +1,37 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+void *Arena::allocate(size_t size, size_t align) {
+    // Move on to the next block until the request fits, creating a block
+    // large enough for it if none of the remaining ones are.
+    while (current < blocks.size()) {
+        std::byte *base = blocks[current].data.get();
+        uintptr_t start = reinterpret_cast<uintptr_t>(base) + offset;
+        size_t padding = (align - start % align) % align;
+        if (offset + padding + size <= blocks[current].size) {
+            offset += padding + size;
+            return base + offset - size;
+        }
+        ++current;
+        offset = 0;
+    }
+
+    size_t blockSize = std::max(BLOCK_SIZE, size + align);
+    blocks.push_back(Block{std::make_unique_for_overwrite<std::byte[]>(blockSize), blockSize});
+    current = blocks.size() - 1;
+    offset = 0;
+    return allocate(size, align);
+}
+
+size_t Arena::capacity() const {
+    size_t total = 0;
+    for (const Block &block : blocks) total += block.size;
+    return total;
+}
+
+Arena &Arena::local() {
+    thread_local Arena arena;
+    return arena;
+}
@@ -0,0 +1,169 @@
+#include "daemon.h"
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "distributed.h"
+
+namespace {
+// Splits what a client sends into lines.
+struct LineReader {
+    int socket;
+    std::string buffer;
+
+    // Return the next line without its line ending, or false once the client
+    // has disconnected.
+    bool next(std::string &line) {
+        size_t end;
+        while ((end = buffer.find('\n')) == std::string::npos) {
+            char chunk[4096];
+            ssize_t received = recv(socket, chunk, sizeof(chunk), 0);
+            if (received <= 0) return false;
+            buffer.append(chunk, received);
+        }
+        line = buffer.substr(0, end);
+        buffer.erase(0, end + 1);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        return true;
+    }
+};
+
+// Parse N comma separated numbers. Returns false unless the whole text is
+// consumed.
+template <size_t N>
+bool parseList(const std::string &text, std::array<double, N> &values) {
+    std::istringstream in(text);
+    for (size_t i = 0; i < N; ++i) {
+        char comma;
+        if (i > 0 && !(in >> comma && comma == ',')) return false;
+        if (!(in >> values[i])) return false;
+    }
+    return (in >> std::ws).eof();
+}
+
+// Parse N comma separated whole numbers that fit in T.
+template <typename T, size_t N>
+bool parseIntegers(const std::string &text, std::array<T, N> &values) {
+    std::array<double, N> numbers;
+    if (!parseList(text, numbers)) return false;
+    for (size_t i = 0; i < N; ++i) {
+        double n = numbers[i];
+        if (n != std::floor(n) || n < std::numeric_limits<T>::min() ||
+            n > std::numeric_limits<T>::max()) {
+            return false;
+        }
+        values[i] = static_cast<T>(n);
+    }
+    return true;
+}
+}  // namespace
+
+void RenderDaemon::add(const std::string &name, Scene &scene) { scenes[name] = &scene; }
+
+std::string RenderDaemon::handle(const std::string &request, bool &stop) {
+    std::istringstream in(request);
+    std::string command;
+    in >> command;
+    if (command == "list") {
+        std::string reply = "ok";
+        for (const auto &[name, scene] : scenes) reply += " " + name;
+        return reply;
+    }
+    if (command == "shutdown") {
+        stop = true;
+        return "ok";
+    }
+    if (command != "render") return "error unknown command " + command;
+
+    std::string name, path;
+    if (!(in >> name >> path)) return "error usage: render <scene> <output.png> [key=value ...]";
+    auto found = scenes.find(name);
+    if (found == scenes.end()) return "error no scene named " + name;
+    Scene &scene = *found->second;
+
+    RenderSettings settings;
+    std::array<double, 3> from, to, up{0, 1, 0};
+    std::array<double, 1> fov{60}, aperture{0}, focus{0};
+    bool hasFrom = false, hasTo = false;
+    std::string option;
+    while (in >> option) {
+        size_t equals = option.find('=');
+        std::string key = option.substr(0, equals);
+        std::string value = equals == std::string::npos ? "" : option.substr(equals + 1);
+        std::array<unsigned, 1> samples;
+        std::array<uint32_t, 1> seed;
+        std::array<int, 4> crop;
+        bool ok = true;
+        if (key == "samples") {
+            ok = parseIntegers(value, samples);
+            if (ok) settings.samples = samples[0];
+        } else if (key == "seed") {
+            ok = parseIntegers(value, seed);
+            if (ok) settings.seed = seed[0];
+        } else if (key == "integrator") {
+            ok = value == "recursive" || value == "wavefront";
+            if (ok) {
+                settings.integrator =
+                        value == "wavefront" ? WavefrontIntegrator : RecursiveIntegrator;
+            }
+        } else if (key == "crop") {
+            ok = parseIntegers(value, crop);
+            if (ok) settings.crop = Tile{crop[0], crop[1], crop[2], crop[3]};
+        } else if (key == "from") {
+            ok = hasFrom = parseList(value, from);
+        } else if (key == "to") {
+            ok = hasTo = parseList(value, to);
+        } else if (key == "up") {
+            ok = parseList(value, up);
+        } else if (key == "fov") {
+            ok = parseList(value, fov);
+        } else if (key == "aperture") {
+            ok = parseList(value, aperture);
+        } else if (key == "focus") {
+            ok = parseList(value, focus);
+        } else {
+            return "error unknown option " + key;
+        }
+        if (!ok) return "error bad value for " + key;
+    }
+    if (hasFrom != hasTo) return "error from and to must be given together";
+
+    // The camera of a request only lasts for that request.
+    Camera original = scene.getCamera();
+    if (hasFrom) {
+        scene.setCamera(Camera(original.getViewport(), Pnt3(from[0], from[1], from[2]),
+                               Pnt3(to[0], to[1], to[2]), Vec3(up[0], up[1], up[2]), fov[0],
+                               aperture[0], focus[0]));
+    }
+    auto start = std::chrono::steady_clock::now();
+    bool rendered = scene.render(path, settings);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    scene.setCamera(original);
+    if (!rendered) return "error could not render or save " + path;
+    return "ok " + std::to_string(elapsed.count());
+}
+
+bool RenderDaemon::serve(const std::string &address) {
+    int listener = distributed::listen(address);
+    if (listener < 0) return false;
+
+    bool stop = false;
+    while (!stop) {
+        int socket = distributed::accept(listener, 1);
+        if (socket < 0) continue;
+
+        LineReader reader{socket, {}};
+        std::string line;
+        while (!stop && reader.next(line)) {
+            if (line.empty()) continue;
+            std::string reply = handle(line, stop) + "\n";
+            if (!distributed::sendAll(socket, reply.data(), reply.size())) break;
+        }
+        ::close(socket);
+    }
+    distributed::close(listener, address);
+    return true;
+}
@@ -0,0 +1,431 @@
+#include "distributed.h"
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include "scene.h"
+
+extern char **environ;
+
+namespace distributed {
+namespace {
+// A parsed address.
+struct Endpoint {
+    bool local;
+    std::string path;
+    std::string host, port;
+};
+
+bool parse(const std::string &address, Endpoint &endpoint) {
+    if (address.rfind("unix:", 0) == 0) {
+        endpoint.local = true;
+        endpoint.path = address.substr(5);
+        return !endpoint.path.empty() && endpoint.path.size() < sizeof(sockaddr_un::sun_path);
+    }
+    size_t colon = address.rfind(':');
+    if (address.rfind("tcp:", 0) == 0 && colon > 3) {
+        endpoint.local = false;
+        endpoint.host = address.substr(4, colon - 4);
+        endpoint.port = address.substr(colon + 1);
+        return !endpoint.port.empty();
+    }
+    return false;
+}
+
+sockaddr_un unixAddress(const std::string &path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    return addr;
+}
+
+// Resolve a TCP endpoint. Returns null after printing an error.
+addrinfo *resolve(const Endpoint &endpoint, bool passive) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    addrinfo *result = nullptr;
+    const char *host = endpoint.host.empty() ? nullptr : endpoint.host.c_str();
+    int error = getaddrinfo(host, endpoint.port.c_str(), &hints, &result);
+    if (error != 0) {
+        std::cout << "Error: could not resolve " << endpoint.host << ":" << endpoint.port << ": "
+                  << gai_strerror(error) << std::endl;
+        return nullptr;
+    }
+    return result;
+}
+
+// Try once to connect to an endpoint. Returns the socket or -1.
+int tryConnect(const Endpoint &endpoint) {
+    if (endpoint.local) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr = unixAddress(endpoint.path);
+        if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0) {
+            return fd;
+        }
+        if (fd >= 0) ::close(fd);
+        return -1;
+    }
+
+    addrinfo *addresses = resolve(endpoint, false);
+    int fd = -1;
+    for (addrinfo *a = addresses; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd >= 0 && ::connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    if (addresses) freeaddrinfo(addresses);
+    if (fd >= 0) {
+        // Tiles are sent in one piece, so there is nothing to gain from
+        // holding small writes back.
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+}  // namespace
+
+int listen(const std::string &address) {
+    Endpoint endpoint;
+    if (!parse(address, endpoint)) {
+        std::cout << "Error: " << address << " is not a unix:<path> or tcp:<host>:<port> address"
+                  << std::endl;
+        return -1;
+    }
+
+    int fd = -1;
+    if (endpoint.local) {
+        unlink(endpoint.path.c_str());
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr = unixAddress(endpoint.path);
+        if (fd >= 0 && bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    } else {
+        addrinfo *addresses = resolve(endpoint, true);
+        for (addrinfo *a = addresses; a && fd < 0; a = a->ai_next) {
+            fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            int one = 1;
+            if (fd >= 0) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (fd >= 0 && bind(fd, a->ai_addr, a->ai_addrlen) != 0) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        if (addresses) freeaddrinfo(addresses);
+    }
+
+    if (fd < 0 || ::listen(fd, SOMAXCONN) != 0) {
+        std::cout << "Error: could not listen on " << address << ": " << std::strerror(errno)
+                  << std::endl;
+        if (fd >= 0) ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int connect(const std::string &address, double timeout) {
+    Endpoint endpoint;
+    if (!parse(address, endpoint)) {
+        std::cout << "Error: " << address << " is not a unix:<path> or tcp:<host>:<port> address"
+                  << std::endl;
+        return -1;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeout);
+    while (true) {
+        int fd = tryConnect(endpoint);
+        if (fd >= 0) return fd;
+        if (std::chrono::steady_clock::now() >= deadline) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    std::cout << "Error: could not connect to " << address << std::endl;
+    return -1;
+}
+
+int accept(int listener, double timeout) {
+    pollfd fd{listener, POLLIN, 0};
+    if (poll(&fd, 1, static_cast<int>(timeout * 1000)) <= 0) return -1;
+    return ::accept(listener, nullptr, nullptr);
+}
+
+void close(int listener, const std::string &address) {
+    ::close(listener);
+    Endpoint endpoint;
+    if (parse(address, endpoint) && endpoint.local) unlink(endpoint.path.c_str());
+}
+
+bool sendAll(int socket, const void *data, size_t size) {
+    const char *bytes = static_cast<const char *>(data);
+    while (size > 0) {
+        // A worker that has gone away must not kill the coordinator with
+        // SIGPIPE.
+        ssize_t sent = send(socket, bytes, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        bytes += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+bool receiveAll(int socket, void *data, size_t size) {
+    char *bytes = static_cast<char *>(data);
+    while (size > 0) {
+        ssize_t received = recv(socket, bytes, size, 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return false;
+        bytes += received;
+        size -= received;
+    }
+    return true;
+}
+
+std::vector<pid_t> spawnWorkers(const std::string &executable, const std::string &address,
+                                int count) {
+    std::vector<pid_t> workers;
+    std::string mode = "--worker";
+    for (int i = 0; i < count; ++i) {
+        char *argv[] = {const_cast<char *>(executable.c_str()), mode.data(),
+                        const_cast<char *>(address.c_str()), nullptr};
+        pid_t pid;
+        int error = posix_spawnp(&pid, executable.c_str(), nullptr, nullptr, argv, environ);
+        if (error != 0) {
+            std::cout << "Error: could not start worker " << executable << ": "
+                      << std::strerror(error) << std::endl;
+            break;
+        }
+        workers.push_back(pid);
+    }
+    return workers;
+}
+
+void waitForWorkers(const std::vector<pid_t> &workers) {
+    for (pid_t pid : workers) waitpid(pid, nullptr, 0);
+}
+}  // namespace distributed
+
+namespace {
+// Tiles are sent until the worker has this many to trace, so that it starts
+// on the next one while the previous one travels back.
+const size_t TILES_IN_FLIGHT = 2;
+
+// How long the coordinator waits for a worker while none is connected.
+const double WORKER_TIMEOUT = 30;
+
+// A tile with no pixels tells a worker that the render is done.
+const Tile DONE_TILE{0, 0, 0, 0};
+
+distributed::Hello hello(int width, int height, size_t primitives, size_t lights) {
+    distributed::Hello message{};
+    std::memcpy(message.magic, distributed::MAGIC, sizeof(message.magic));
+    message.version = distributed::VERSION;
+    message.width = width;
+    message.height = height;
+    message.primitives = static_cast<uint32_t>(primitives);
+    message.lights = static_cast<uint32_t>(lights);
+    return message;
+}
+
+size_t tileBytes(const Tile &tile) {
+    return 4 * static_cast<size_t>(tile.x1 - tile.x0) * (tile.y1 - tile.y0);
+}
+}  // namespace
+
+bool Scene::renderDistributed(const std::string &path, const RenderSettings &settings,
+                              const std::string &address) {
+    if (!checkCropWindow(settings)) return false;
+    int listener = distributed::listen(address);
+    if (listener < 0) return false;
+
+    std::shared_ptr<Image> img = cam.getViewport().getImg();
+    distributed::Hello expected =
+            hello(img->getWidth(), img->getHeight(), primitives.size(), lights.size());
+    distributed::JobSettings job{settings.samples, static_cast<uint32_t>(settings.sampler),
+                                 settings.seed, static_cast<uint32_t>(settings.integrator),
+                                 settings.sortRays};
+
+    // The viewport's image still holds the previous render, which a crop
+    // window would otherwise be composited into when there is no file yet.
+    auto [width, height] = outputSize(settings);
+    if (img->getWidth() != width || img->getHeight() != height || hasCrop(settings)) {
+        img = std::make_shared<Image>(width, height);
+    }
+    loadComposite(*img, path, settings);
+
+    // Tiles are handed out in image coordinates.
+    Tile window = cropWindow(settings);
+    std::deque<Tile> pending;
+    for (Tile tile : Film(window).tiles(JOB_SIZE)) {
+        pending.push_back(Tile{tile.x0 + window.x0, tile.y0 + window.y0, tile.x1 + window.x0,
+                               tile.y1 + window.y0});
+    }
+    int left = settings.cropMode == CroppedImage ? window.x0 : 0;
+    int top = settings.cropMode == CroppedImage ? window.y0 : 0;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t remaining = pending.size();
+    int connected = 0;
+
+    // Hand tiles to one worker until there are none left. Tiles that a lost
+    // worker was tracing go back to the queue for the others.
+    auto serve = [&](int socket) {
+        distributed::Hello message;
+        bool ok = distributed::receiveAll(socket, &message, sizeof(message)) &&
+                  std::memcmp(&message, &expected, sizeof(message)) == 0 &&
+                  distributed::sendAll(socket, &job, sizeof(job));
+        if (!ok) std::cout << "Error: turned away a worker with a different scene" << std::endl;
+
+        std::deque<Tile> inFlight;
+        size_t sent = 0;
+        std::vector<unsigned char> pixels;
+        while (ok) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (inFlight.empty()) {
+                    cv.wait(lock, [&] { return !pending.empty() || remaining == 0; });
+                }
+                while (inFlight.size() < TILES_IN_FLIGHT && !pending.empty()) {
+                    inFlight.push_back(pending.front());
+                    pending.pop_front();
+                }
+            }
+            if (inFlight.empty()) {
+                distributed::sendAll(socket, &DONE_TILE, sizeof(Tile));
+                break;
+            }
+            for (; ok && sent < inFlight.size(); ++sent) {
+                ok = distributed::sendAll(socket, &inFlight[sent], sizeof(Tile));
+            }
+
+            Tile tile = inFlight.front();
+            pixels.resize(tileBytes(tile));
+            Tile received;
+            ok = ok && distributed::receiveAll(socket, &received, sizeof(Tile)) &&
+                 std::memcmp(&received, &tile, sizeof(Tile)) == 0 &&
+                 distributed::receiveAll(socket, pixels.data(), pixels.size());
+            if (!ok) break;
+
+            // Tiles never overlap, so they are written without the lock.
+            img->paste(pixels.data(), tile.x1 - tile.x0, tile.y1 - tile.y0, tile.x0 - left,
+                       tile.y0 - top);
+            inFlight.pop_front();
+            --sent;
+            std::lock_guard<std::mutex> lock(mutex);
+            --remaining;
+            if (remaining == 0) cv.notify_all();
+        }
+
+        ::close(socket);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!ok && !inFlight.empty()) {
+            std::cout << "Lost a worker, handing its tiles to the others" << std::endl;
+            pending.insert(pending.begin(), inFlight.begin(), inFlight.end());
+        }
+        --connected;
+        cv.notify_all();
+    };
+
+    std::vector<std::thread> connections;
+    bool complete;
+    {
+        stats::PhaseTimer timer(stats::Trace);
+        timeline::Scope scope("trace");
+        auto idleSince = std::chrono::steady_clock::now();
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                complete = remaining == 0;
+                if (complete) break;
+                if (connected > 0) idleSince = std::chrono::steady_clock::now();
+            }
+            std::chrono::duration<double> idle = std::chrono::steady_clock::now() - idleSince;
+            if (idle.count() > WORKER_TIMEOUT) break;
+
+            int socket = distributed::accept(listener, 0.1);
+            if (socket < 0) continue;
+            std::lock_guard<std::mutex> lock(mutex);
+            ++connected;
+            connections.emplace_back(serve, socket);
+        }
+        distributed::close(listener, address);
+        for (auto &thread : connections) thread.join();
+    }
+
+    if (!complete) {
+        std::cout << "Error: no workers connected to " << address << " for " << WORKER_TIMEOUT
+                  << " seconds" << std::endl;
+        return false;
+    }
+
+    bool saved;
+    {
+        stats::PhaseTimer timer(stats::Encode);
+        saved = img->save(path);
+    }
+    if constexpr (stats::ENABLED) std::cout << stats::collect().toJson() << std::endl;
+    return saved;
+}
+
+bool Scene::serveTiles(const std::string &address) {
+    int socket = distributed::connect(address);
+    if (socket < 0) return false;
+
+    std::shared_ptr<Image> img = cam.getViewport().getImg();
+    distributed::Hello message =
+            hello(img->getWidth(), img->getHeight(), primitives.size(), lights.size());
+    distributed::JobSettings job;
+    if (!distributed::sendAll(socket, &message, sizeof(message)) ||
+        !distributed::receiveAll(socket, &job, sizeof(job))) {
+        std::cout << "Error: the coordinator at " << address << " turned this worker away"
+                  << std::endl;
+        ::close(socket);
+        return false;
+    }
+
+    RenderSettings settings(job.samples);
+    settings.sampler = static_cast<SamplerType>(job.sampler);
+    settings.seed = job.seed;
+    settings.integrator = static_cast<IntegratorType>(job.integrator);
+    settings.sortRays = job.sortRays != 0;
+
+    Tile tile;
+    while (distributed::receiveAll(socket, &tile, sizeof(Tile))) {
+        if (tile.x1 <= tile.x0 || tile.y1 <= tile.y0) {
+            ::close(socket);
+            return true;
+        }
+
+        // Each tile is split again into tiles for this machine's threads.
+        Film film(tile);
+        size_t pixels = static_cast<size_t>(film.getWidth()) * film.getHeight();
+        traceTiles(film, std::vector<unsigned>(pixels, settings.samples), settings);
+        Image result(film.getWidth(), film.getHeight());
+        film.resolve(result);
+        if (!distributed::sendAll(socket, &tile, sizeof(Tile)) ||
+            !distributed::sendAll(socket, result.data(), tileBytes(tile))) {
+            break;
+        }
+    }
+
+    std::cout << "Error: lost the connection to the coordinator at " << address << std::endl;
+    ::close(socket);
+    return false;
+}
@@ -0,0 +1,175 @@
+#include "film.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include "scene.h"
+
+namespace {
+// Identifies checkpoint files. Bump the version whenever the layout changes.
+const char CHECKPOINT_MAGIC[4] = {'R', 'T', 'C', 'K'};
+const uint32_t CHECKPOINT_VERSION = 3;
+
+// Stops of the heatmap color scale, evenly spaced from no cost to the most.
+const Color HEATMAP_STOPS[] = {
+        Color{0.00, 0.00, 0.02}, Color{0.34, 0.06, 0.43}, Color{0.73, 0.21, 0.33},
+        Color{0.98, 0.55, 0.04}, Color{0.99, 1.00, 0.64},
+};
+
+// Map x in [0, 1] onto the heatmap scale.
+Color heatmapColor(double x) {
+    const int segments = std::size(HEATMAP_STOPS) - 1;
+    double position = std::clamp(x, 0.0, 1.0) * segments;
+    int i = std::min(static_cast<int>(position), segments - 1);
+    Real t = static_cast<Real>(position - i);
+    return HEATMAP_STOPS[i] * (1 - t) + HEATMAP_STOPS[i + 1] * t;
+}
+
+template <typename T>
+void write(std::ostream &os, const T &value) {
+    os.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+bool read(std::istream &is, T &value) {
+    return static_cast<bool>(is.read(reinterpret_cast<char *>(&value), sizeof(T)));
+}
+}  // namespace
+
+Film::Film(int width, int height) : Film(Tile{0, 0, width, height}) {}
+
+Film::Film(const Tile &window)
+        : width(window.x1 - window.x0), height(window.y1 - window.y0), left(window.x0),
+          top(window.y0), pixels(width * height), costs(width * height) {}
+
+void Film::addSample(int row, int col, const Color &color) {
+    Pixel &p = pixels[row * width + col];
+    p.sum += color;
+
+    // Welford's online algorithm for the variance.
+    Real luminance = color.luminance();
+    p.count++;
+    Real delta = luminance - p.mean;
+    p.mean += delta / p.count;
+    p.m2 += delta * (luminance - p.mean);
+}
+
+unsigned Film::count(int row, int col) const {
+    return pixels[row * width + col].count;
+}
+
+Color Film::estimate(int row, int col) const {
+    const Pixel &p = pixels[row * width + col];
+    if (p.count == 0) return Color{0, 0, 0};
+    return p.sum / p.count;
+}
+
+Real Film::relativeError(int row, int col) const {
+    const Pixel &p = pixels[row * width + col];
+    if (p.count < 2) return INFINITY;
+    Real variance = p.m2 / (p.count - 1);
+    return std::sqrt(variance / p.count) / std::max(p.mean, Real(0.1));
+}
+
+void Film::resolve(Image &img, int x, int y) const {
+    for (int row = 0; row < height; ++row) {
+        for (int col = 0; col < width; ++col) {
+            Color color = estimate(row, col);
+            color.clamp();
+            img.setPixel(y + row, x + col, color);
+        }
+    }
+}
+
+void Film::resolveCost(Image &img) const {
+    if (costs.empty()) return;
+    std::vector<double> sorted = costs;
+    auto percentile = sorted.begin() + static_cast<std::ptrdiff_t>(0.99 * (sorted.size() - 1));
+    std::nth_element(sorted.begin(), percentile, sorted.end());
+    double scale = *percentile > 0 ? 1 / *percentile : 0;
+
+    for (int row = 0; row < height; ++row) {
+        for (int col = 0; col < width; ++col) {
+            img.setPixel(row, col, heatmapColor(cost(row, col) * scale));
+        }
+    }
+}
+
+bool Film::save(const std::string &path, const CheckpointInfo &info) const {
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream os(tmpPath, std::ios::binary | std::ios::trunc);
+        os.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        write(os, CHECKPOINT_VERSION);
+        write(os, static_cast<uint32_t>(sizeof(Real)));
+        write(os, static_cast<int32_t>(width));
+        write(os, static_cast<int32_t>(height));
+        write(os, static_cast<int32_t>(left));
+        write(os, static_cast<int32_t>(top));
+        write(os, info);
+        for (const Pixel &p : pixels) {
+            write(os, p.sum.r);
+            write(os, p.sum.g);
+            write(os, p.sum.b);
+            write(os, p.mean);
+            write(os, p.m2);
+            write(os, static_cast<uint32_t>(p.count));
+        }
+        if (!os) {
+            std::cout << "Error: could not write checkpoint " << tmpPath << std::endl;
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tmpPath, path, error);
+    if (error) {
+        std::cout << "Error: could not write checkpoint " << path << ": "
+                  << error.message() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Film::load(const std::string &path, CheckpointInfo &info) {
+    std::ifstream is(path, std::ios::binary);
+    if (!is) return false;
+
+    char magic[4];
+    uint32_t version, scalarSize;
+    int32_t fileWidth, fileHeight, fileLeft, fileTop;
+    if (!is.read(magic, sizeof(magic)) ||
+        std::memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0 ||
+        !read(is, version) || version != CHECKPOINT_VERSION ||
+        !read(is, scalarSize) || scalarSize != sizeof(Real) ||
+        !read(is, fileWidth) || !read(is, fileHeight) ||
+        !read(is, fileLeft) || !read(is, fileTop) ||
+        fileWidth != width || fileHeight != height || fileLeft != left || fileTop != top ||
+        !read(is, info)) {
+        return false;
+    }
+
+    std::vector<Pixel> loaded(pixels.size());
+    for (Pixel &p : loaded) {
+        uint32_t count;
+        if (!read(is, p.sum.r) || !read(is, p.sum.g) || !read(is, p.sum.b) ||
+            !read(is, p.mean) || !read(is, p.m2) || !read(is, count)) {
+            return false;
+        }
+        p.count = count;
+    }
+    pixels = std::move(loaded);
+    return true;
+}
+
+std::vector<Tile> Film::tiles(int size) const {
+    std::vector<Tile> result;
+    for (int y = 0; y < height; y += size) {
+        for (int x = 0; x < width; x += size) {
+            result.push_back(Tile{x, y, std::min(x + size, width),
+                                  std::min(y + size, height)});
+        }
+    }
+    return result;
+}
@@ -1,17 +1,65 @@
+#include <cstring>
+#include "animation.h"
+#include "daemon.h"
+#include "distributed.h"
 #include "scene.h"
 
 using namespace std;
 
-int main() {
+// Usage: raytracer [output.png] [samples] [timeline.json]
+//        raytracer --distribute <address> <local workers> [output.png] [samples]
+//        raytracer --worker <address>
+//        raytracer --serve <address>
+//        raytracer --animate <frames> [frame####.png] [samples]
+//
+// With --distribute the image is traced by worker processes, the given number
+// of which are started on this machine. More can be started elsewhere with
+// --worker. With --serve the scene stays loaded and is rendered on request
+// under the name "demo"; see RenderDaemon. Addresses are unix:<path> or
+// tcp:<host>:<port>. With --animate the camera dollies in while the glass
+// sphere bounces, at 24 frames per second.
+int main(int argc, char **argv) {
+    string executable = argv[0];
+    string worker, coordinator, daemon;
+    int localWorkers = 0, frames = 0;
+    if (argc > 2 && strcmp(argv[1], "--worker") == 0) {
+        worker = argv[2];
+        argv += 2;
+        argc -= 2;
+    } else if (argc > 2 && strcmp(argv[1], "--serve") == 0) {
+        daemon = argv[2];
+        argv += 2;
+        argc -= 2;
+    } else if (argc > 2 && strcmp(argv[1], "--animate") == 0) {
+        frames = stoi(argv[2]);
+        argv += 2;
+        argc -= 2;
+    } else if (argc > 3 && strcmp(argv[1], "--distribute") == 0) {
+        coordinator = argv[2];
+        localWorkers = stoi(argv[3]);
+        argv += 3;
+        argc -= 3;
+    }
+
+    string path = argc > 1 ? argv[1] : frames > 0 ? "frame####.png" : "img.png";
+    RenderSettings settings(argc > 2 ? stoi(argv[2]) : 2);
+
+    // Record from the start so that the timeline includes building the scene.
+    if (worker.empty() && coordinator.empty() && daemon.empty() && frames == 0 && argc > 3) {
+        settings.timelinePath = argv[3];
+        timeline::start();
+    }
+
     // VIEWPORT
     Viewport vp(2, 800, 16.0 / 9.0);
 
     // MATERIAL
-    auto m1 = Material::from(MaterialType::Glass, Color::grey());
-    auto m2 = Material::from(MaterialType::PolishedMetal, Color::grey());
-    auto m3 = Material::from(MaterialType::Plastic, Color::white());
-    auto m4 = Material::from(MaterialType::Plastic, Color(0.9803, 0.501, 0.447));
-    auto m5 = Material::from(MaterialType::Plastic, Color(0.341, 0.463, 0.831));
+    MaterialTable materials;
+    MaterialId m1 = materials.add(Material::from(MaterialType::Glass, Color::grey()));
+    MaterialId m2 = materials.add(Material::from(MaterialType::PolishedMetal, Color::grey()));
+    MaterialId m3 = materials.add(Material::from(MaterialType::Plastic, Color::white()));
+    MaterialId m4 = materials.add(Material::from(MaterialType::Plastic, Color(0.9803, 0.501, 0.447)));
+    MaterialId m5 = materials.add(Material::from(MaterialType::Plastic, Color(0.341, 0.463, 0.831)));
 
     // GEOMETRY
     auto sphereGeometry1 = make_shared<Sphere>(Pnt3(1.0, -0.7, -1.0), 0.7);
@@ -48,6 +96,29 @@ int main() {
     Camera cam(vp, Pnt3(0, 0, 3), 1);
 
     // RENDER
-    Scene scene(objs, lights, cam);
-    scene.render("img.png", 2);
+    Scene scene(objs, materials, lights, cam);
+    if (!worker.empty()) return scene.serveTiles(worker) ? 0 : 1;
+    if (frames > 0) {
+        Animation animation;
+        animation.addCameraKey(CameraKey{0, Pnt3(0, 0, 3), Pnt3(0, -0.4, -1.5)});
+        animation.addCameraKey(CameraKey{2, Pnt3(0.6, 0.4, 2.2), Pnt3(0, -0.4, -1.5)});
+        PrimitiveHandle glass{SpherePrimitive, 0};
+        animation.addObjectKey(glass, ObjectKey{0, Pnt3(1.0, -0.7, -1.0), 0.7});
+        animation.addObjectKey(glass, ObjectKey{1, Pnt3(1.0, 0.3, -1.0), 0.7});
+        animation.addObjectKey(glass, ObjectKey{2, Pnt3(1.0, -0.7, -1.0), 0.7});
+        animation.render(scene, path, frames, 24, settings);
+        return 0;
+    }
+    if (!daemon.empty()) {
+        RenderDaemon renderDaemon;
+        renderDaemon.add("demo", scene);
+        return renderDaemon.serve(daemon) ? 0 : 1;
+    }
+    if (!coordinator.empty()) {
+        vector<pid_t> workers = distributed::spawnWorkers(executable, coordinator, localWorkers);
+        bool rendered = scene.renderDistributed(path, settings, coordinator);
+        distributed::waitForWorkers(workers);
+        return rendered ? 0 : 1;
+    }
+    return scene.render(path, settings) ? 0 : 1;
 }
\ No newline at end of file
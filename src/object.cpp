@@ -1,30 +1,50 @@
 #include "object.h"
 
+#include <algorithm>
 #include <cmath>
 
-Mat4 Geometry::inverse() const { return transform.inverse(); }
+void Geometry::setTransform(const Mat4 &m) {
+    transform = m;
+    inverseTransform = m.inverse();
+}
 
-Geometry &Geometry::move(double x, double y, double z) {
-    transform.setTranslate(x, y, z);
+Geometry &Geometry::move(Real x, Real y, Real z) {
+    Mat4 m = transform;
+    m.setTranslate(x, y, z);
+    setTransform(m);
     return *this;
 }
 
-Geometry &Geometry::translate(double dx, double dy, double dz) {
-    transform.translate(dx, dy, dz);
+Geometry &Geometry::translate(Real dx, Real dy, Real dz) {
+    Mat4 m = transform;
+    m.translate(dx, dy, dz);
+    setTransform(m);
     return *this;
 }
 
-Geometry &Geometry::scale(double scalar) {
-    transform.scale(scalar);
+Geometry &Geometry::scale(Real scalar) {
+    Mat4 m = transform;
+    m.scale(scalar);
+    setTransform(m);
     return *this;
 }
 
-Geometry &Geometry::scale(double kx, double ky, double kz) {
-    transform.scale(kx, ky, kz);
+Geometry &Geometry::scale(Real kx, Real ky, Real kz) {
+    Mat4 m = transform;
+    m.scale(kx, ky, kz);
+    setTransform(m);
     return *this;
 }
 
-void Geometry::setCoordSystem(Mat4 m) { transform = m * transform; }
+void Geometry::setCoordSystem(Mat4 m) { setTransform(m * transform); }
+
+void Geometry::hit(const RayStream &rays, Real *minusT, Real *plusT) const {
+    for (size_t i = 0; i < rays.size(); ++i) {
+        auto result = hit(rays.get(i));
+        minusT[i] = result ? result->first : NAN;
+        plusT[i] = result ? result->second : NAN;
+    }
+}
 
 Vec3 Geometry::invertNormal(const Vec3 &normal, const Mat4 &inverse) {
     Mat3 inverseTranspose = inverse.extractLinear();
@@ -32,42 +52,135 @@ Vec3 Geometry::invertNormal(const Vec3 &normal, const Mat4 &inverse) {
     return (inverseTranspose * normal);
 }
 
-double Sphere::radius() const { return transform[0][0]; }
+Real Sphere::radius() const { return transform[0][0]; }
 
 Pnt3 Sphere::center() const {
     return Pnt3(transform[0][3], transform[1][3], transform[2][3]);
 }
 
-std::optional<std::pair<double, double>> Sphere::hit(const Ray &ray) const {
+Bounds Sphere::bounds() const {
+    // The unit sphere reaches furthest along a world axis in the direction of
+    // the matching row of the transform, by the length of that row.
+    Pnt3 c = center();
+    Vec3 extent{Vec3(transform[0][0], transform[0][1], transform[0][2]).length(),
+                Vec3(transform[1][0], transform[1][1], transform[1][2]).length(),
+                Vec3(transform[2][0], transform[2][1], transform[2][2]).length()};
+    return Bounds{c + -extent, c + extent};
+}
+
+std::optional<std::pair<Real, Real>> Sphere::hit(const Ray &ray) const {
     Vec3 oc = ray.origin - Pnt3(0, 0, 0);
-    double a = ray.direction.dot(ray.direction);
-    double b = ray.direction.dot(oc);
-    double c = oc.dot(oc) - 1.0;
-    double discriminant = b * b - a * c;
+    Real a = ray.direction.dot(ray.direction);
+    Real b = ray.direction.dot(oc);
+    Real c = oc.dot(oc) - 1.0;
+    Real discriminant = b * b - a * c;
 
     if (discriminant < 0) {
         return std::nullopt;
     } else {
-        double minusT = (-b - std::sqrt(discriminant)) / a;
-        double plusT = (-b + std::sqrt(discriminant)) / a;
+        Real minusT = (-b - std::sqrt(discriminant)) / a;
+        Real plusT = (-b + std::sqrt(discriminant)) / a;
         return std::make_pair(minusT, plusT);
     }
 }
 
+void Sphere::hit(const RayStream &rays, Real *minusT, Real *plusT) const {
+    hitUnit(rays, minusT, plusT);
+}
+
+template <typename T>
+void Sphere::hitUnit(const RayStreamT<T> &rays, T *__restrict minusT,
+                     T *__restrict plusT) {
+    const T *ox = rays.ox.data(), *oy = rays.oy.data(), *oz = rays.oz.data();
+    const T *dx = rays.dx.data(), *dy = rays.dy.data(), *dz = rays.dz.data();
+    size_t n = rays.size();
+    for (size_t i = 0; i < n; ++i) {
+        T a = dx[i] * dx[i] + dy[i] * dy[i] + dz[i] * dz[i];
+        T b = dx[i] * ox[i] + dy[i] * oy[i] + dz[i] * oz[i];
+        T c = ox[i] * ox[i] + oy[i] * oy[i] + oz[i] * oz[i] - T(1);
+        T discriminant = b * b - a * c;
+
+        // Select instead of branching so that the loop vectorizes. Misses come
+        // out as NaN, which fails every comparison the caller makes.
+        T root = std::sqrt(std::max(discriminant, T(0)));
+        T miss = discriminant < 0 ? T(NAN) : T(0);
+        minusT[i] = (-b - root) / a + miss;
+        plusT[i] = (-b + root) / a + miss;
+    }
+}
+
+template void Sphere::hitUnit(const RayStreamT<float> &, float *, float *);
+template void Sphere::hitUnit(const RayStreamT<double> &, double *, double *);
+
+std::pair<float, float> Sphere::surfaceCoords(float x, float y, float z) {
+    float u = 0.5f + std::atan2(z, x) / float(2 * M_PI);
+    float v = std::acos(std::clamp(y, -1.0f, 1.0f)) / float(M_PI);
+    return std::make_pair(u, v);
+}
+
 Vec3 Sphere::normal(const Pnt3 &point) const { return (point - Pnt3(0, 0, 0)); }
 
-std::shared_ptr<Material> Material::from(const MaterialType type,
-                                         const Color &color) {
-    switch (type) {
-        case MaterialType::Matte:
-            return std::make_shared<Material>(color, 0.05, 1.0, 0.0, 30.0, 0.0, 0.0, 1.0);
-        case MaterialType::Plastic:
-            return std::make_shared<Material>(color, 0.05, 0.4, 0.8, 100.0, 0.0, 0.0, 1.0);
-        case MaterialType::PolishedMetal:
-            return std::make_shared<Material>(color, 0.05, 0.05, 0.8, 60.0, 0.80, 0.0, 1.0);
-        case MaterialType::Glass:
-            return std::make_shared<Material>(color, 0.05, 0.0, 0.5, 150.0, 0.40, 0.80, 1.56);
+PrimitiveHandle Primitives::add(const Sphere &sphere, MaterialId material) {
+    spheres.push_back(sphere);
+    sphereMaterials.push_back(material);
+    sphereInverses.push_back(sphere.inverse());
+    sphereBounds.push_back(sphere.bounds());
+    return PrimitiveHandle{SpherePrimitive, static_cast<std::uint32_t>(spheres.size() - 1)};
+}
+
+PrimitiveHandle Primitives::add(const Object &obj) {
+    switch (obj.geometry->type()) {
+        case SpherePrimitive:
+        default:
+            return add(static_cast<const Sphere &>(*obj.geometry), obj.material);
+    }
+}
+
+const Geometry &Primitives::geometry(PrimitiveHandle handle) const {
+    switch (handle.type) {
+        case SpherePrimitive:
         default:
-            return std::make_shared<Material>(color, 0.05, 0.9, 0.1, 30.0, 0.0, 0.0, 1.0);
+            return spheres[handle.index];
     }
+}
+
+MaterialId Primitives::material(PrimitiveHandle handle) const {
+    switch (handle.type) {
+        case SpherePrimitive:
+        default:
+            return sphereMaterials[handle.index];
+    }
+}
+
+void Primitives::setTransform(PrimitiveHandle handle, const Mat4 &transform) {
+    switch (handle.type) {
+        case SpherePrimitive:
+        default: {
+            Sphere &sphere = spheres[handle.index];
+            sphere = Sphere();
+            sphere.setCoordSystem(transform);
+            sphereInverses[handle.index] = sphere.inverse();
+            sphereBounds[handle.index] = sphere.bounds();
+            break;
+        }
+    }
+}
+
+Material Material::from(const MaterialType type, const Color &color) {
+    Material material = [&] {
+        switch (type) {
+            case MaterialType::Matte:
+                return Material(color, 0.05, 1.0, 0.0, 30.0, 0.0, 0.0, 1.0);
+            case MaterialType::Plastic:
+                return Material(color, 0.05, 0.4, 0.8, 100.0, 0.0, 0.0, 1.0);
+            case MaterialType::PolishedMetal:
+                return Material(color, 0.05, 0.05, 0.8, 60.0, 0.80, 0.0, 1.0);
+            case MaterialType::Glass:
+                return Material(color, 0.05, 0.0, 0.5, 150.0, 0.40, 0.80, 1.56);
+            default:
+                return Material(color, 0.05, 0.9, 0.1, 30.0, 0.0, 0.0, 1.0);
+        }
+    }();
+    material.type = type;
+    return material;
 }
\ No newline at end of file
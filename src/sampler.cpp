@@ -0,0 +1,165 @@
+#include "sampler.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+// Finalizer of MurmurHash3. Scrambles all of the bits of a 64-bit integer.
+uint64_t mixBits(uint64_t v) {
+    v ^= v >> 33;
+    v *= 0xff51afd7ed558ccdull;
+    v ^= v >> 33;
+    v *= 0xc4ceb9fe1a85ec53ull;
+    v ^= v >> 33;
+    return v;
+}
+
+// Hash up to three integers into a 32-bit seed.
+uint32_t hash(uint32_t a, uint32_t b, uint32_t c = 0) {
+    uint64_t h = mixBits((static_cast<uint64_t>(a) << 32) | b);
+    return static_cast<uint32_t>(mixBits(h ^ (c + 0x9e3779b97f4a7c15ull)));
+}
+
+// The largest Real that is less than one.
+const Real ONE_MINUS_EPSILON = 1 - std::numeric_limits<Real>::epsilon() / 2;
+
+// Convert a number in the range [0, 1) to a Real without rounding up to one.
+Real toReal(double x) { return std::min(static_cast<Real>(x), ONE_MINUS_EPSILON); }
+
+// Convert a 32-bit integer to a number in the range [0, 1).
+double toUnit(uint32_t x) { return x * 0x1p-32; }
+
+uint32_t reverseBits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ff) << 8) | ((x & 0xff00ff00) >> 8);
+    x = ((x & 0x0f0f0f0f) << 4) | ((x & 0xf0f0f0f0) >> 4);
+    x = ((x & 0x33333333) << 2) | ((x & 0xcccccccc) >> 2);
+    x = ((x & 0x55555555) << 1) | ((x & 0xaaaaaaaa) >> 1);
+    return x;
+}
+
+// Hash-based Owen scrambling from Burley, "Practical Hash-based Owen
+// Scrambling" (2020). Every bit is flipped based on the bits above it, which
+// keeps the stratification of the sequence intact.
+uint32_t owenScramble(uint32_t x, uint32_t seed) {
+    x = reverseBits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverseBits(x);
+}
+
+// The first two dimensions of the Sobol sequence.
+uint32_t sobol0(uint32_t i) { return reverseBits(i); }
+
+uint32_t sobol1(uint32_t i) {
+    uint32_t result = 0;
+    for (uint32_t v = 1u << 31; i; i >>= 1, v ^= v >> 1) {
+        if (i & 1) result ^= v;
+    }
+    return result;
+}
+
+// Return the element at index i of a random permutation of [0, n). From
+// Kensler, "Correlated Multi-Jittered Sampling" (2013).
+uint32_t permute(uint32_t i, uint32_t n, uint32_t seed) {
+    uint32_t w = n - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    do {
+        i ^= seed;
+        i *= 0xe170893d;
+        i ^= seed >> 16;
+        i ^= (i & w) >> 4;
+        i ^= seed >> 8;
+        i *= 0x0929eb3f;
+        i ^= seed >> 23;
+        i ^= (i & w) >> 1;
+        i *= 1 | seed >> 27;
+        i *= 0x6935fa69;
+        i ^= (i & w) >> 11;
+        i *= 0x74dcb303;
+        i ^= (i & w) >> 2;
+        i *= 0x9e501cc3;
+        i ^= (i & w) >> 2;
+        i *= 0xc860a3df;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= n);
+    return (i + seed) % n;
+}
+
+// Interleaved gradient noise from Jimenez, "Next Generation Post Processing in
+// Call of Duty: Advanced Warfare" (2014). A cheap per-pixel value whose
+// spectrum is close to blue noise.
+double gradientNoise(double x, double y) {
+    double f = 0.06711056 * x + 0.00583715 * y;
+    f = 52.9829189 * (f - std::floor(f));
+    return f - std::floor(f);
+}
+
+double wrap(double x) { return x >= 1.0 ? x - 1.0 : x; }
+}  // namespace
+
+Point2 SampleStream::get(unsigned k) const {
+    return sampler.sample(dimension, sampler.sampleIndex * count + k,
+                          sampler.samplesPerPixel * count);
+}
+
+void Sampler::startPixelSample(int x, int y, unsigned index) {
+    pixelHash = hash(static_cast<uint32_t>(x), static_cast<uint32_t>(y), seed);
+    px = x;
+    py = y;
+    sampleIndex = index;
+    dimension = 0;
+}
+
+Real Sampler::get1D() { return sample(dimension++, sampleIndex, samplesPerPixel).u; }
+
+Point2 Sampler::get2D() { return sample(dimension++, sampleIndex, samplesPerPixel); }
+
+SampleStream Sampler::stream2D(unsigned n) { return SampleStream(*this, dimension++, n); }
+
+Point2 Sampler::sample(uint32_t dim, uint32_t i, uint32_t n) const {
+    switch (type) {
+        case SamplerType::Stratified: {
+            uint32_t nx = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(n))));
+            uint32_t ny = (n + nx - 1) / nx;
+            // Once every stratum has been used, start over with a new
+            // permutation.
+            uint32_t cells = nx * ny;
+            uint32_t cell = permute(i % cells, cells, hash(pixelHash, dim, i / cells));
+            uint32_t jitter = hash(pixelHash, ~dim, i);
+            double u = ((cell % nx) + toUnit(hash(jitter, 0))) / nx;
+            double v = ((cell / nx) + toUnit(hash(jitter, 1))) / ny;
+            return Point2{toReal(u), toReal(v)};
+        }
+        case SamplerType::Sobol: {
+            uint32_t dimHash = hash(pixelHash, dim);
+            uint32_t index = owenScramble(i, dimHash);
+            return Point2{toReal(toUnit(owenScramble(sobol0(index), hash(dimHash, 1)))),
+                          toReal(toUnit(owenScramble(sobol1(index), hash(dimHash, 2))))};
+        }
+        case SamplerType::BlueNoise: {
+            // The scrambling only depends on the dimension, so that neighbouring
+            // pixels walk the same sequence and differ only by their rotation.
+            uint32_t dimHash = hash(seed, dim);
+            uint32_t index = owenScramble(i, dimHash);
+            double u = toUnit(owenScramble(sobol0(index), hash(dimHash, 1)));
+            double v = toUnit(owenScramble(sobol1(index), hash(dimHash, 2)));
+            double shift = 5.588238 * dim;
+            return Point2{toReal(wrap(u + gradientNoise(px + shift, py))),
+                          toReal(wrap(v + gradientNoise(px + 47, py + 17 + shift)))};
+        }
+        case SamplerType::Independent:
+        default: {
+            uint32_t h = hash(pixelHash, dim, i);
+            return Point2{toReal(toUnit(hash(h, 0))), toReal(toUnit(hash(h, 1)))};
+        }
+    }
+}
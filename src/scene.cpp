@@ -1,7 +1,73 @@
 #include "scene.h"
 #include "utils.h"
+#include "wavefront.h"
+#include "writer.h"
 #include <algorithm>
-#include <random>
+#include <chrono>
+#include <filesystem>
+
+namespace {
+// Make primitive id the closest hit of every ray whose entry time into it is
+// in [tMin, nearest). Written without branches and with restrict qualified
+// arrays so that the loop vectorizes.
+template <typename T>
+void keepNearer(size_t n, std::uint32_t id, const T *__restrict entry,
+                const T *__restrict tMin, T *__restrict nearest,
+                std::uint32_t *__restrict closest) {
+    for (size_t i = 0; i < n; ++i) {
+        bool closer = (entry[i] >= tMin[i]) & (entry[i] < nearest[i]);
+        nearest[i] = closer ? entry[i] : nearest[i];
+        closest[i] = closer ? id : closest[i];
+    }
+}
+
+// The box around the origins of a chunk of rays, and for each axis whether
+// every ray of the chunk moves towards +, towards - or neither.
+struct ChunkExtent {
+    Real lower[3], upper[3];
+    bool positive[3], negative[3];
+};
+
+ChunkExtent extentOf(const RayStream &rays, size_t first, size_t n) {
+    const std::vector<Real> *origins[3] = {&rays.ox, &rays.oy, &rays.oz};
+    const std::vector<Real> *directions[3] = {&rays.dx, &rays.dy, &rays.dz};
+    ChunkExtent extent;
+    for (int axis = 0; axis < 3; ++axis) {
+        const Real *o = origins[axis]->data() + first;
+        const Real *d = directions[axis]->data() + first;
+        Real lower = o[0], upper = o[0];
+        bool positive = true, negative = true;
+        for (size_t i = 0; i < n; ++i) {
+            lower = std::min(lower, o[i]);
+            upper = std::max(upper, o[i]);
+            positive &= d[i] > 0;
+            negative &= d[i] < 0;
+        }
+        extent.lower[axis] = lower;
+        extent.upper[axis] = upper;
+        extent.positive[axis] = positive;
+        extent.negative[axis] = negative;
+    }
+    return extent;
+}
+
+// Return whether a box lies behind every ray of a chunk along some axis. No
+// ray of the chunk can then hit anything inside it.
+bool behind(const ChunkExtent &extent, const Bounds &bounds) {
+    const Real lower[3] = {bounds.lower.x, bounds.lower.y, bounds.lower.z};
+    const Real upper[3] = {bounds.upper.x, bounds.upper.y, bounds.upper.z};
+    bool culled = false;
+    for (int axis = 0; axis < 3; ++axis) {
+        culled |= extent.positive[axis] & (upper[axis] < extent.lower[axis]);
+        culled |= extent.negative[axis] & (lower[axis] > extent.upper[axis]);
+    }
+    return culled;
+}
+
+// The number of rays the calling thread has passed to castRay, for the ray
+// count heatmap.
+thread_local uint64_t raysCast = 0;
+}  // namespace
 
 const Color Viewport::BACKGROUND_COLOR = Color{0.5, 0.5, 0.5};
 const Color Viewport::OBJ_COLOR = Color{1, 0, 0};
@@ -10,31 +76,93 @@ Vec3 Viewport::dx() const { return Vec3{width / img->getWidth(), 0, 0}; }
 
 Vec3 Viewport::dy() const { return Vec3{0, height / img->getHeight(), 0}; }
 
-Pnt3 Viewport::bottomLeft(Pnt3 camPosition, double focalLength) const {
+Pnt3 Viewport::bottomLeft(Pnt3 camPosition, Real focalLength) const {
     return Pnt3(camPosition + Vec3{-width / 2, -height / 2, -focalLength} +
                             dx() / 2 + dy() / 2);
 }
 
+Camera::Camera(const Viewport &viewport, Pnt3 position, Real focalLength)
+        : viewport(viewport), focalLength(focalLength) {
+    transform = Mat4::identity();
+    transform.translate(position);
+    firstPixel = viewport.bottomLeft(position, focalLength);
+    pixelRight = viewport.dx();
+    pixelUp = viewport.dy();
+    imgHeight = viewport.getImg()->getHeight();
+}
+
+Camera::Camera(const Viewport &viewport, Pnt3 from, Pnt3 to, Vec3 up, Real vfov,
+               Real aperture, Real focusDistance)
+        : viewport(viewport) {
+    Vec3 backward = (from - to).normalize();
+    Vec3 right = Vec3::cross(up, backward).normalize();
+    Vec3 trueUp = Vec3::cross(backward, right);
+
+    transform = Mat4::identity();
+    const Vec3 *axes[3] = {&right, &trueUp, &backward};
+    for (int col = 0; col < 3; ++col) {
+        transform[0][col] = axes[col]->x;
+        transform[1][col] = axes[col]->y;
+        transform[2][col] = axes[col]->z;
+    }
+    transform.translate(from);
+
+    // The image is laid out on the plane in focus, so that rays from anywhere
+    // on the lens through a pixel meet there.
+    if (focusDistance <= 0) focusDistance = (to - from).length();
+    focalLength = focusDistance;
+    std::shared_ptr<Image> img = viewport.getImg();
+    Real height = 2 * focusDistance * std::tan(vfov * Real(M_PI / 360));
+    Real width = height * img->getWidth() / img->getHeight();
+    pixelRight = right * (width / img->getWidth());
+    pixelUp = trueUp * (height / img->getHeight());
+    firstPixel = from + (backward * -focusDistance - right * (width / 2) - trueUp * (height / 2) +
+                         pixelRight / 2 + pixelUp / 2);
+    imgHeight = img->getHeight();
+
+    pinhole = aperture <= 0;
+    lensRight = right * (aperture / 2);
+    lensUp = trueUp * (aperture / 2);
+}
+
 Pnt3 Camera::getPosition() const {
     return Pnt3(transform[0][3], transform[1][3], transform[2][3]);
 }
 
 Viewport Camera::getViewport() const { return viewport; }
 
-double Camera::getFocalLength() const { return focalLength; }
+Real Camera::getFocalLength() const { return focalLength; }
+
+Ray Camera::generateRay(int row, int col, Point2 jitter, Point2 lens) const {
+    // Rows are counted from the top of the image but the viewport is laid out
+    // from the bottom.
+    Real x = col + jitter.u - 0.5;
+    Real y = imgHeight - 1 - row + jitter.v - 0.5;
+    Pnt3 targetPixel = firstPixel + pixelRight * x + pixelUp * y;
+
+    Pnt3 origin = getPosition();
+    if (!pinhole) {
+        Vec3 disk = Vec3::unitDisk(lens.u, lens.v);
+        origin = origin + lensRight * disk.x + lensUp * disk.y;
+    }
+    return Ray{origin, (targetPixel - origin).normalize()};
+}
 
 float Scene::BIAS = 1e-4;
 
 Color Scene::transmission(const Pnt3 &point, Vec3 &viewDirection, Vec3 &normal,
-                                                    const std::shared_ptr<Material> &material,
-                                                    const double ki, const double kt, unsigned char depth,
-                                                    const unsigned char maxDepth) const {
+                                                    const Material &material,
+                                                    const Real ki, const Real kt, unsigned char depth,
+                                                    const unsigned char maxDepth, Sampler &sampler) const {
     Color avgColor = Color::black();
     Vec3 refractDirection = Vec3::refract(viewDirection, normal, ki, kt);
     unsigned char samples = 6;
+    SampleStream stream = sampler.stream2D(samples);
+    stats::count(stats::RefractionRays, samples);
 
     for (unsigned char i = 0; i < samples; ++i) {
-        Vec3 offset = Vec3::randomUnitVector() * 0.10;
+        Point2 u = stream.get(i);
+        Vec3 offset = Vec3::unitSphere(u.u, u.v) * 0.10;
 
         if (Vec3::dot(offset, normal) < 0) {
             offset = -offset;
@@ -43,34 +171,38 @@ Color Scene::transmission(const Pnt3 &point, Vec3 &viewDirection, Vec3 &normal,
         Vec3 offsetRefraction = refractDirection + offset;
         Ray refractionRay{point + offsetRefraction * BIAS, offsetRefraction};
         auto result = castRay(refractionRay);
-        double reflectance = utils::fresnel(Vec3::dot(viewDirection, -normal), 1.5);
+        Real reflectance = utils::fresnel(Vec3::dot(viewDirection, -normal), 1.5);
 
         if (!result.has_value() || depth >= maxDepth) {
             avgColor += Viewport::BACKGROUND_COLOR;
         } else {
-            avgColor += shade(std::move(result.value()), depth + 1);
+            avgColor += shade(result.value(), depth + 1, sampler);
         }
     }
 
     avgColor /= samples;
-    double cosTheta = Vec3::dot(viewDirection, -normal);
-    double reflectance = utils::fresnel(cosTheta, 1.5);
-    avgColor *= material->color * (1 - reflectance);
+    Real cosTheta = Vec3::dot(viewDirection, -normal);
+    Real reflectance = utils::fresnel(cosTheta, 1.5);
+    avgColor *= material.color * (1 - reflectance);
     return avgColor;
 }
 
 Color Scene::reflection(const Pnt3 &point, const Vec3 &viewDirection,
                                                 const Vec3 &normal,
-                                                const std::shared_ptr<Material> &material,
+                                                const Material &material,
                                                 unsigned char depth,
-                                                const unsigned char maxDepth) const {
+                                                const unsigned char maxDepth,
+                                                Sampler &sampler) const {
     Color color = Color::black();
     Vec3 reflectDirection = Vec3::reflect(viewDirection, normal);
 
     const unsigned char samples = 6;
+    SampleStream stream = sampler.stream2D(samples);
+    stats::count(stats::ReflectionRays, samples);
     Color avgColor = Color::black();
     for (unsigned char i = 0; i < samples; ++i) {
-        Vec3 offset = Vec3::randomUnitVector() * 0.02;
+        Point2 u = stream.get(i);
+        Vec3 offset = Vec3::unitSphere(u.u, u.v) * 0.02;
 
         if (Vec3::dot(offset, normal) < 0) {
             offset = -offset;
@@ -85,19 +217,19 @@ Color Scene::reflection(const Pnt3 &point, const Vec3 &viewDirection,
         if (!result.has_value() || depth >= maxDepth) {
             avgColor += Viewport::BACKGROUND_COLOR;
         } else {
-            avgColor += shade(std::move(result.value()), depth + 1);
+            avgColor += shade(result.value(), depth + 1, sampler);
         }
     }
 
     avgColor /= samples;
 
     // adjust the color by the material's properties.
-    if (material->transparency > 0) {
-        double cosTheta = Vec3::dot(viewDirection, -normal);
-        double reflectance = utils::fresnel(cosTheta, 1.5);
-        avgColor *= material->color * reflectance;
+    if (material.transparency > 0) {
+        Real cosTheta = Vec3::dot(viewDirection, -normal);
+        Real reflectance = utils::fresnel(cosTheta, 1.5);
+        avgColor *= material.color * reflectance;
     } else {
-        avgColor *= material->color * material->reflectance;
+        avgColor *= material.color * material.reflectance;
     }
 
     return avgColor;
@@ -105,69 +237,78 @@ Color Scene::reflection(const Pnt3 &point, const Vec3 &viewDirection,
 
 Color Scene::lighting(const Pnt3 &point, const Vec3 &viewDirection,
                                             const Vec3 &normal,
-                                            const std::shared_ptr<Material> &material,
-                                            unsigned char samples) const {
+                                            const Material &material,
+                                            unsigned char samples,
+                                            Sampler &sampler) const {
 
-    Color totalColor = Color{1, 1, 1} * material->ambient;
+    Color totalColor = Color{1, 1, 1} * material.ambient;
     for (const auto &light : lights) {
         auto squareLight = dynamic_cast<SquareLight *>(light.get());
-        std::vector<Pnt3> lightPoints = squareLight->getRandomPoints(samples);
+        SampleStream stream = sampler.stream2D(samples);
+        stats::count(stats::ShadowRays, samples);
 
         unsigned blockedRays = 0;
         Color lightColor{0, 0, 0};
-        for (const auto lightPoint : lightPoints) {
+        for (unsigned char i = 0; i < samples; ++i) {
+            Point2 u = stream.get(i);
+            Pnt3 lightPoint = squareLight->samplePoint(u.u, u.v);
             Vec3 lightDirection = (lightPoint - point);
-            double lightDistance = lightDirection.length();
+            Real lightDistance = lightDirection.length();
             lightDirection /= lightDistance;
             Ray shadowRay{point + lightDirection * BIAS, lightDirection};
             auto result = castRay(shadowRay);
 
             // No hit. Light source is obstructed by another object.
             if (result.has_value()) {
-                double hitDistance = (result.value()->point - point).length();
+                Real hitDistance = (result->point - point).length();
                 if (hitDistance < lightDistance) {
                     blockedRays++;
                     continue;
                 }
             }
 
-            double attenuation = light->intensity / (lightDistance * lightDistance);
+            Real attenuation = light->intensity / (lightDistance * lightDistance);
             lightColor += utils::phong(material, light, lightDirection,
                                  -viewDirection, normal) *
                                         attenuation;
         }
 
-        double shadowIntensity =
-                static_cast<double>(blockedRays) / static_cast<double>(samples);
+        Real shadowIntensity =
+                static_cast<Real>(blockedRays) / static_cast<Real>(samples);
         totalColor += (lightColor / samples) * (1 - shadowIntensity);
     }
 
     return totalColor;
 }
 
-Color Scene::shade(std::unique_ptr<Hit> hit, unsigned char depth) const {
-    Mat4 worldTransform = hit->object->geometry->getTransform();
-    Mat4 objTransform = hit->object->geometry->inverse();
-    Pnt3 pointWorld = hit->point;
-    Vec3 normal = hit->object->geometry->normal(objTransform * pointWorld);
-    normal = Geometry::invertNormal(normal, objTransform).normalize();
-    Vec3 normalWorld = (worldTransform * normal).normalize();
-    Vec3 viewDirection = hit->direction;
-    double reflectance = hit->object->material->reflectance;
-    double transparency = hit->object->material->transparency;
+Color Scene::shade(const Hit &hit, unsigned char depth,
+                   Sampler &sampler) const {
+    const Geometry &geometry = primitives.geometry(hit.primitive);
+    const Mat4 &objTransform = geometry.inverse();
+    Pnt3 pointWorld = hit.point;
+    Vec3 normal = geometry.normal(objTransform * pointWorld);
 
-    Color total = Color::white() * hit->object->material->ambient;
+    // Normals map to world space through the inverse transpose, which keeps
+    // them perpendicular to the surface under non-uniform scaling and shear.
+    Vec3 normalWorld = Geometry::invertNormal(normal, objTransform).normalize();
+    Vec3 viewDirection = hit.direction;
+    const Material &material = materials[primitives.material(hit.primitive)];
+    stats::countShading(material.type);
+    Real reflectance = material.reflectance;
+    Real transparency = material.transparency;
+
+    Color total = Color::white() * material.ambient;
 
     total += lighting(pointWorld, viewDirection, normalWorld,
-                                        hit->object->material, 5);
+                                        material, 5, sampler);
     if (reflectance > 0 && depth < 4) {
         total += reflection(pointWorld, viewDirection, normalWorld,
-                                                hit->object->material, depth, 4) *
+                                                material, depth, 4, sampler) *
              pow(0.3, depth);
     }
     if (transparency > 0 && depth < 4) {
         total += transmission(pointWorld, viewDirection, normalWorld,
-                                                    hit->object->material, 1.0, 1.5, depth, 4) *
+                                                    material, 1.0, 1.5, depth, 4, sampler) *
              pow(0.3, depth);
     }
 
@@ -175,13 +316,20 @@ Color Scene::shade(std::unique_ptr<Hit> hit, unsigned char depth) const {
     return total;
 }
 
-std::optional<std::unique_ptr<Hit>> Scene::castRay(Ray &ray) const {
-    std::shared_ptr<Object> closestObj = nullptr;
-    double minMinusT = std::numeric_limits<double>::max();
-    double minPlusT = 0;
-    for (const auto &obj : objs) {
-        Ray objSpaceRay = ray.transformed(obj->geometry->inverse());
-        auto hitResult = obj->geometry->hit(objSpaceRay);
+std::optional<Hit> Scene::castRay(Ray &ray) const {
+    std::optional<PrimitiveHandle> closest;
+    Real minMinusT = std::numeric_limits<Real>::max();
+    Real minPlusT = 0;
+
+    // Each primitive type is intersected from its own array. Sphere::hit
+    // works on the unit sphere and reads nothing from the sphere itself.
+    const std::vector<Sphere> &spheres = primitives.getSpheres();
+    const std::vector<Mat4> &inverses = primitives.getSphereInverses();
+    stats::count(stats::IntersectionTests, spheres.size());
+    ++raysCast;
+    for (std::uint32_t i = 0; i < spheres.size(); ++i) {
+        Ray objSpaceRay = ray.transformed(inverses[i]);
+        auto hitResult = spheres[i].hit(objSpaceRay);
 
         if (!hitResult.has_value()) continue;
 
@@ -192,67 +340,532 @@ std::optional<std::unique_ptr<Hit>> Scene::castRay(Ray &ray) const {
         if (minusT < minMinusT) {
             minMinusT = minusT;
             minPlusT = plusT;
-            closestObj = obj;
+            closest = PrimitiveHandle{SpherePrimitive, i};
         }
     }
 
     // No hit
-    if (!closestObj) {
+    if (!closest) {
         return std::nullopt;
     }
 
     Pnt3 closestPoint = ray.at(minMinusT);
-    return std::make_unique<Hit>(closestObj, closestPoint, ray.direction,
-                               minMinusT, minPlusT);
-}
-
-void Scene::render(const std::string &path, unsigned samples) {
-    // Viewport setup
-    Viewport viewport = cam.getViewport();
-    Vec3 dx = viewport.dx();
-    Vec3 dy = viewport.dy();
-    double dxLen = dx.length();
-    double dyLen = dy.length();
-    Pnt3 bottomLeft =
-            viewport.bottomLeft(cam.getPosition(), cam.getFocalLength());
-
-    // RNG setup
-    std::mt19937 gen(5);
-    std::uniform_real_distribution<double> distX(-dxLen / 2.0, dxLen / 2.0);
-    std::uniform_real_distribution<double> distY(-dyLen / 2.0, dyLen / 2.0);
-
-    // Random offsets that we'll add to the center pixel.
-    std::vector<Vec3> offsets(samples);
-    std::generate(offsets.begin(), offsets.end(),
-                                [&]() { return Vec3(distX(gen), distY(gen), 0); });
-    // Image setup
-    std::shared_ptr<Image> img = viewport.getImg();
+    return Hit{*closest, closestPoint, ray.direction, minMinusT, minPlusT};
+}
 
-    // Shoot a ray through each viewport pixel.
-    for (int i = 0; i < img->getHeight(); ++i) {
-        for (int j = 0; j < img->getWidth(); ++j) {
-            Color avgColor{0, 0, 0};
-            for (const auto &offset : offsets) {
-                Pnt3 targetPixel =
-                        bottomLeft + dx * (double)j + dy * (double)i + offset;
-                Vec3 direction = (targetPixel - cam.getPosition()).normalize();
-                Ray viewRay{cam.getPosition(), direction};
-                auto result = castRay(viewRay);
-
-                if (!result.has_value()) {
-                    avgColor += Viewport::BACKGROUND_COLOR;
-                    continue;
+std::span<const std::optional<Hit>> Scene::castRays(const RayStream &rays,
+                                                    Arena &arena) const {
+    size_t n = rays.size();
+
+    // The stream in object space is reused across calls, and the hit times
+    // live in the arena, so casting a stream does not allocate once both have
+    // grown to the stream size.
+    thread_local RayStream objSpaceRays;
+    std::span<Real> minusT = arena.allocateArray<Real>(n);
+    std::span<Real> plusT = arena.allocateArray<Real>(n);
+    std::span<Real> minMinusT = arena.allocateArray<Real>(n);
+    std::span<Real> minPlusT = arena.allocateArray<Real>(n);
+    std::span<std::optional<PrimitiveHandle>> closest =
+            arena.allocateArray<std::optional<PrimitiveHandle>>(n);
+    std::fill(minMinusT.begin(), minMinusT.end(), std::numeric_limits<Real>::max());
+
+    const std::vector<Sphere> &spheres = primitives.getSpheres();
+    const std::vector<Mat4> &inverses = primitives.getSphereInverses();
+    stats::count(stats::IntersectionTests, n * spheres.size());
+    for (std::uint32_t k = 0; k < spheres.size(); ++k) {
+        rays.transformed(inverses[k], objSpaceRays);
+        spheres[k].hit(objSpaceRays, minusT.data(), plusT.data());
+
+        // Misses are NaN and fail both comparisons.
+        for (size_t i = 0; i < n; ++i) {
+            if (minusT[i] >= 0 && minusT[i] < minMinusT[i]) {
+                minMinusT[i] = minusT[i];
+                minPlusT[i] = plusT[i];
+                closest[i] = PrimitiveHandle{SpherePrimitive, k};
+            }
+        }
+    }
+
+    std::span<std::optional<Hit>> hits = arena.allocateArray<std::optional<Hit>>(n);
+    for (size_t i = 0; i < n; ++i) {
+        if (!closest[i]) continue;
+        Ray ray = rays.get(i);
+        hits[i] = Hit{*closest[i], ray.at(minMinusT[i]), ray.direction, minMinusT[i],
+                      minPlusT[i]};
+    }
+    return hits;
+}
+
+void Scene::intersect(std::span<const CompactRay> rays, std::span<CompactHit> hits,
+                      Arena &arena) const {
+    // Single precision copies of the inverse transforms, made once per call.
+    const std::vector<Mat4> &inverses = primitives.getSphereInverses();
+    std::span<Mat4T<float>> sphereInverses = arena.allocateArray<Mat4T<float>>(inverses.size());
+    for (size_t k = 0; k < inverses.size(); ++k) sphereInverses[k] = Mat4T<float>(inverses[k]);
+
+    thread_local RayStreamT<float> chunk, objSpaceChunk;
+    std::span<float> tMin = arena.allocateArray<float>(INTERSECT_CHUNK);
+    std::span<float> nearest = arena.allocateArray<float>(INTERSECT_CHUNK);
+    std::span<float> minusT = arena.allocateArray<float>(INTERSECT_CHUNK);
+    std::span<float> plusT = arena.allocateArray<float>(INTERSECT_CHUNK);
+    std::span<std::uint32_t> closest = arena.allocateArray<std::uint32_t>(INTERSECT_CHUNK);
+
+    for (size_t first = 0; first < rays.size(); first += INTERSECT_CHUNK) {
+        size_t n = std::min(INTERSECT_CHUNK, rays.size() - first);
+        chunk.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            const CompactRay &ray = rays[first + i];
+            chunk.ox[i] = ray.origin[0];
+            chunk.oy[i] = ray.origin[1];
+            chunk.oz[i] = ray.origin[2];
+            chunk.dx[i] = ray.direction[0];
+            chunk.dy[i] = ray.direction[1];
+            chunk.dz[i] = ray.direction[2];
+            tMin[i] = ray.tMin;
+            nearest[i] = ray.tMax;
+            closest[i] = CompactHit::NONE;
+        }
+        stats::count(stats::IntersectionTests, n * sphereInverses.size());
+
+        for (std::uint32_t k = 0; k < sphereInverses.size(); ++k) {
+            chunk.transformed(sphereInverses[k], objSpaceChunk);
+            Sphere::hitUnit(objSpaceChunk, minusT.data(), plusT.data());
+
+            // Like castRay, a ray only hits a sphere where it enters it. Misses
+            // are NaN and fail both comparisons.
+            keepNearer(n, PrimitiveHandle{SpherePrimitive, k}.pack(), minusT.data(),
+                       tMin.data(), nearest.data(), closest.data());
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            hits[first + i].t = nearest[i];
+            hits[first + i].primitive = closest[i];
+        }
+    }
+}
+
+void Scene::intersect(const RayStream &rays, std::span<Real> t,
+                      std::span<std::uint32_t> primitive, Arena &arena) const {
+    const std::vector<Mat4> &inverses = primitives.getSphereInverses();
+    const std::vector<Bounds> &bounds = primitives.getSphereBounds();
+
+    thread_local RayStream objSpaceChunk;
+    std::span<Real> tMin = arena.allocateArray<Real>(INTERSECT_CHUNK);
+    std::span<Real> minusT = arena.allocateArray<Real>(INTERSECT_CHUNK);
+    std::span<Real> plusT = arena.allocateArray<Real>(INTERSECT_CHUNK);
+
+    for (size_t first = 0; first < rays.size(); first += INTERSECT_CHUNK) {
+        size_t n = std::min(INTERSECT_CHUNK, rays.size() - first);
+        Real *nearest = t.data() + first;
+        std::uint32_t *closest = primitive.data() + first;
+        std::fill_n(nearest, n, std::numeric_limits<Real>::max());
+        std::fill_n(closest, n, CompactHit::NONE);
+
+        // Spheres that the whole chunk points away from are skipped. That only
+        // happens often when the rays of a chunk go the same way, as they do
+        // once they are sorted.
+        ChunkExtent extent = extentOf(rays, first, n);
+        size_t culled = 0;
+        for (std::uint32_t k = 0; k < inverses.size(); ++k) {
+            if (behind(extent, bounds[k])) {
+                ++culled;
+                continue;
+            }
+            rays.transformed(inverses[k], first, n, objSpaceChunk);
+            Sphere::hitUnit(objSpaceChunk, minusT.data(), plusT.data());
+            keepNearer(n, PrimitiveHandle{SpherePrimitive, k}.pack(), minusT.data(),
+                       tMin.data(), nearest, closest);
+        }
+        stats::count(stats::IntersectionTests, n * (inverses.size() - culled));
+        stats::count(stats::CulledTests, n * culled);
+    }
+}
+
+void Scene::surfaceCoords(std::span<const CompactRay> rays,
+                          std::span<CompactHit> hits) const {
+    const std::vector<Mat4> &inverses = primitives.getSphereInverses();
+    for (size_t i = 0; i < rays.size(); ++i) {
+        CompactHit &hit = hits[i];
+        if (hit.primitive == CompactHit::NONE) continue;
+
+        Ray ray = rays[i].toRay();
+        PrimitiveHandle handle = PrimitiveHandle::unpack(hit.primitive);
+        switch (handle.type) {
+            case SpherePrimitive:
+            default: {
+                Pnt3 local = inverses[handle.index] * ray.at(hit.t);
+                std::tie(hit.u, hit.v) = Sphere::surfaceCoords(local.x, local.y, local.z);
+                break;
+            }
+        }
+    }
+}
+
+bool Scene::render(const std::string &path, const RenderSettings &settings) {
+    if (!checkCropWindow(settings)) return false;
+    bool timeline = !settings.timelinePath.empty();
+    if (timeline && !timeline::recording()) timeline::start();
+
+    // The viewport's image still holds the previous render, which a crop
+    // window would otherwise be composited into when there is no file yet.
+    std::shared_ptr<Image> img = cam.getViewport().getImg();
+    auto [width, height] = outputSize(settings);
+    if (img->getWidth() != width || img->getHeight() != height || hasCrop(settings)) {
+        img = std::make_shared<Image>(width, height);
+    }
+    loadComposite(*img, path, settings);
+    {
+        stats::PhaseTimer timer(stats::Trace);
+        timeline::Scope scope("trace");
+        trace(*img, settings);
+    }
+    bool saved;
+    {
+        stats::PhaseTimer timer(stats::Encode);
+        saved = img->save(path);
+    }
+    if constexpr (stats::ENABLED) std::cout << stats::collect().toJson() << std::endl;
+    if (timeline) timeline::stop(settings.timelinePath);
+    return saved;
+}
+
+void Scene::render(const std::string &path, const RenderSettings &settings,
+                   ImageWriter &writer) {
+    if (!checkCropWindow(settings)) return;
+    bool timeline = !settings.timelinePath.empty();
+    if (timeline && !timeline::recording()) timeline::start();
+
+    // The back buffer still holds the frame before last, which a crop window
+    // would otherwise be composited into when there is no file yet.
+    Image &img = writer.acquire();
+    if (hasCrop(settings)) img.clear();
+    loadComposite(img, path, settings);
+    {
+        stats::PhaseTimer timer(stats::Trace);
+        timeline::Scope scope("trace");
+        trace(img, settings);
+    }
+    // Encoding happens on the writer's thread, so only the hand-off is timed,
+    // and the trace does not wait for the frame to be saved.
+    {
+        stats::PhaseTimer timer(stats::Encode);
+        writer.submit(path);
+    }
+    if constexpr (stats::ENABLED) std::cout << stats::collect().toJson() << std::endl;
+    if (timeline) {
+        // The writer's thread records its encode into the timeline, so it has
+        // to finish before the timeline is saved.
+        writer.flush();
+        timeline::stop(settings.timelinePath);
+    }
+}
+
+void Scene::tracePixel(Film &film, int row, int col, unsigned count,
+                       Sampler &sampler) const {
+    unsigned first = film.count(row, col);
+    for (unsigned s = first; s < first + count; ++s) {
+        // Each pixel gets its own jitter pattern, which depends on where the
+        // pixel is in the image rather than in the film.
+        int imgRow = film.getTop() + row;
+        int imgCol = film.getLeft() + col;
+        sampler.startPixelSample(imgCol, imgRow, s);
+        Point2 jitter = sampler.get2D();
+        Ray viewRay = cam.generateRay(imgRow, imgCol, jitter,
+                                      cam.hasLens() ? sampler.get2D() : Point2{});
+        stats::count(stats::PrimaryRays);
+        auto result = castRay(viewRay);
+
+        if (!result.has_value()) {
+            film.addSample(row, col, Viewport::BACKGROUND_COLOR);
+            continue;
+        }
+
+        film.addSample(row, col, shade(result.value(), 0, sampler));
+    }
+}
+
+void Scene::traceTiles(Film &film, const std::vector<unsigned> &count,
+                       const RenderSettings &settings,
+                       std::chrono::steady_clock::time_point deadline) const {
+    timeline::Scope pass("pass");
+    std::vector<Tile> tiles = film.tiles(TILE_SIZE);
+    utils::parallelFor(static_cast<int>(tiles.size()), [&](int t) {
+        if (std::chrono::steady_clock::now() >= deadline) return;
+        timeline::Scope scope("tile", "tile", t);
+
+        // Scratch memory from the thread's previous tile is no longer needed.
+        Arena::local().reset();
+
+        const Tile &tile = tiles[t];
+        Sampler sampler(settings.sampler, settings.samples, settings.seed);
+        switch (settings.integrator) {
+            case WavefrontIntegrator: {
+                // The queues are kept from tile to tile and, since the
+                // tracing threads outlive a pass, from pass to pass.
+                thread_local Wavefront wavefront;
+                wavefront.trace(*this, film, tile, count, sampler, settings);
+                break;
+            }
+            case RecursiveIntegrator:
+            default: {
+                bool heatmap = !settings.heatmapPath.empty();
+                for (int row = tile.y0; row < tile.y1; ++row) {
+                    for (int col = tile.x0; col < tile.x1; ++col) {
+                        unsigned n = count[row * film.getWidth() + col];
+                        if (n == 0) continue;
+                        if (!heatmap) {
+                            tracePixel(film, row, col, n, sampler);
+                            continue;
+                        }
+
+                        auto start = std::chrono::steady_clock::now();
+                        uint64_t rays = raysCast;
+                        tracePixel(film, row, col, n, sampler);
+                        std::chrono::duration<double, std::nano> elapsed =
+                                std::chrono::steady_clock::now() - start;
+                        film.addCost(row, col, settings.heatmapMetric == RayHeatmap
+                                                       ? static_cast<double>(raysCast - rays)
+                                                       : elapsed.count());
+                    }
                 }
+                break;
+            }
+        }
+        stats::flush();
+    });
+}
+
+void Scene::saveHeatmap(const Film &film, const RenderSettings &settings) const {
+    if (settings.heatmapPath.empty()) return;
+    Image heatmap(film.getWidth(), film.getHeight());
+    film.resolveCost(heatmap);
+    heatmap.save(settings.heatmapPath);
+}
+
+bool Scene::hasCrop(const RenderSettings &settings) {
+    return settings.crop.x1 > settings.crop.x0 && settings.crop.y1 > settings.crop.y0;
+}
 
-                auto hit = std::move(result.value());
-                avgColor += shade(std::move(hit), 0);
+Tile Scene::cropWindow(const RenderSettings &settings) const {
+    std::shared_ptr<Image> img = cam.getViewport().getImg();
+    int width = img->getWidth();
+    int height = img->getHeight();
+    if (!hasCrop(settings)) return Tile{0, 0, width, height};
+    const Tile &crop = settings.crop;
+    return Tile{std::clamp(crop.x0, 0, width), std::clamp(crop.y0, 0, height),
+                std::clamp(crop.x1, 0, width), std::clamp(crop.y1, 0, height)};
+}
+
+bool Scene::checkCropWindow(const RenderSettings &settings) const {
+    Tile window = cropWindow(settings);
+    if (window.x1 > window.x0 && window.y1 > window.y0) return true;
+    std::cout << "Error: the crop window lies outside the image" << std::endl;
+    return false;
+}
+
+std::pair<int, int> Scene::outputSize(const RenderSettings &settings) const {
+    if (settings.cropMode == CroppedImage) {
+        Tile window = cropWindow(settings);
+        return {window.x1 - window.x0, window.y1 - window.y0};
+    }
+    std::shared_ptr<Image> img = cam.getViewport().getImg();
+    return {img->getWidth(), img->getHeight()};
+}
+
+void Scene::loadComposite(Image &img, const std::string &path,
+                          const RenderSettings &settings) const {
+    if (!hasCrop(settings) || settings.cropMode != CompositeCrop) return;
+    if (!std::filesystem::exists(path)) return;
+    if (!img.load(path)) {
+        std::cout << "Error: could not composite the crop window into " << path
+                  << ", which is not a PNG of the same size" << std::endl;
+    }
+}
+
+void Scene::resolve(const Film &film, Image &img, const RenderSettings &settings) const {
+    if (settings.cropMode == CroppedImage) {
+        film.resolve(img);
+    } else {
+        film.resolve(img, film.getLeft(), film.getTop());
+    }
+}
+
+void Scene::trace(Image &img, const RenderSettings &settings) const {
+    Film film(cropWindow(settings));
+    int width = film.getWidth();
+    int height = film.getHeight();
+    size_t pixels = static_cast<size_t>(width) * height;
+    if (pixels == 0) return;
+
+    if (settings.adaptiveThreshold <= 0) {
+        traceTiles(film, std::vector<unsigned>(pixels, settings.samples), settings);
+        resolve(film, img, settings);
+        saveHeatmap(film, settings);
+        return;
+    }
+
+    // Give every pixel enough samples to estimate its error.
+    unsigned first = std::min(settings.minSamples, settings.samples);
+    unsigned maxSamples = std::max(settings.maxSamples, first);
+    std::vector<unsigned> count(pixels, first);
+    traceTiles(film, count, settings);
+    uint64_t budget = static_cast<uint64_t>(settings.samples - first) * pixels;
+
+    // Each round doubles the samples of every pixel that hasn't converged,
+    // noisiest pixels first, until they all converge or the budget runs out.
+    std::vector<std::pair<double, int>> active;
+    while (budget > 0) {
+        active.clear();
+        for (int row = 0; row < height; ++row) {
+            for (int col = 0; col < width; ++col) {
+                double error = film.relativeError(row, col);
+                if (error > settings.adaptiveThreshold &&
+                    film.count(row, col) < maxSamples) {
+                    active.emplace_back(error, row * width + col);
+                }
             }
-            avgColor /= samples;
-            avgColor.clamp();
-            img->setPixel(img->getHeight() - 1 - i, j, avgColor);
         }
+        if (active.empty()) break;
+
+        std::sort(active.begin(), active.end(), std::greater<>());
+        std::fill(count.begin(), count.end(), 0);
+        uint64_t assigned = 0;
+        for (const auto &[error, index] : active) {
+            if (budget == 0) break;
+            // Pixels without samples yet (minSamples = 0) start with one.
+            unsigned taken = film.count(index / width, index % width);
+            uint64_t extra = std::min<uint64_t>(
+                    {std::max(taken, 1u), maxSamples - taken, budget});
+            count[index] = static_cast<unsigned>(extra);
+            budget -= extra;
+            assigned += extra;
+        }
+        if (assigned == 0) break;
+        traceTiles(film, count, settings);
     }
-    img->save(path);
+
+    resolve(film, img, settings);
+    saveHeatmap(film, settings);
+}
+
+void Scene::renderProgressive(const std::string &path,
+                              const RenderSettings &settings) {
+    if (!checkCropWindow(settings)) return;
+    bool timeline = !settings.timelinePath.empty();
+    if (timeline && !timeline::recording()) timeline::start();
+
+    using Clock = std::chrono::steady_clock;
+    Film film(cropWindow(settings));
+    int width = film.getWidth();
+    int height = film.getHeight();
+    size_t pixels = static_cast<size_t>(width) * height;
+
+    // Every image saved is the film resolved over the same base, which is
+    // blank unless a crop window is composited into an existing image.
+    auto [outputWidth, outputHeight] = outputSize(settings);
+    ImageWriter writer(outputWidth, outputHeight);
+    Image base(outputWidth, outputHeight);
+    loadComposite(base, path, settings);
+    auto save = [&]() {
+        Image &img = writer.acquire();
+        img = base;
+        resolve(film, img, settings);
+        writer.submit(path);
+    };
+
+    Clock::time_point start = Clock::now();
+    Clock::time_point deadline = Clock::time_point::max();
+    if (settings.timeBudget > 0) {
+        deadline = start + std::chrono::duration_cast<Clock::duration>(
+                                   std::chrono::duration<double>(settings.timeBudget));
+    }
+    Clock::time_point lastFlush = start;
+    Clock::time_point lastCheckpoint = start;
+
+    CheckpointInfo info{static_cast<uint32_t>(settings.sampler), settings.seed,
+                        settings.samples, 0};
+    bool checkpointing = !settings.checkpointPath.empty();
+    if (checkpointing && std::filesystem::exists(settings.checkpointPath)) {
+        CheckpointInfo saved;
+        if (film.load(settings.checkpointPath, saved) &&
+            saved.sampler == info.sampler && saved.seed == info.seed &&
+            saved.samples == info.samples) {
+            info.pass = saved.pass;
+        } else {
+            std::cout << "Ignoring checkpoint " << settings.checkpointPath
+                      << " from a different render" << std::endl;
+            film = Film(cropWindow(settings));
+        }
+    }
+
+    bool adaptive = settings.adaptiveThreshold > 0;
+    bool complete = true;
+    std::vector<unsigned> count(pixels);
+    for (; info.pass < settings.samples; ++info.pass) {
+        if (Clock::now() >= deadline) {
+            complete = false;
+            break;
+        }
+
+        // Bring every pixel up to pass + 1 samples. Pixels can already be there
+        // if the render was interrupted part way through this pass.
+        bool converged = adaptive && info.pass >= settings.minSamples;
+        for (int row = 0; row < height; ++row) {
+            for (int col = 0; col < width; ++col) {
+                // Skip pixels that have converged.
+                bool done = adaptive && info.pass >= settings.minSamples &&
+                            film.relativeError(row, col) <= settings.adaptiveThreshold;
+                bool behind = film.count(row, col) <= info.pass;
+                count[row * width + col] = !done && behind ? 1 : 0;
+                converged = converged && done;
+            }
+        }
+        if (converged) break;
+
+        {
+            stats::PhaseTimer timer(stats::Trace);
+            traceTiles(film, count, settings, deadline);
+        }
+
+        // The pass may have been cut short. It stays the current pass so that
+        // a resumed render finishes it.
+        Clock::time_point now = Clock::now();
+        if (now >= deadline) {
+            complete = false;
+            break;
+        }
+
+        if (settings.flushInterval > 0 &&
+            std::chrono::duration<double>(now - lastFlush).count() >= settings.flushInterval) {
+            save();
+            lastFlush = now;
+        }
+        if (checkpointing &&
+            std::chrono::duration<double>(now - lastCheckpoint).count() >= settings.checkpointInterval) {
+            // The pass is saved as the next one to do.
+            CheckpointInfo next = info;
+            next.pass++;
+            film.save(settings.checkpointPath, next);
+            lastCheckpoint = now;
+        }
+    }
+
+    {
+        stats::PhaseTimer timer(stats::Encode);
+        save();
+    }
+    saveHeatmap(film, settings);
+
+    if (checkpointing) {
+        if (complete) {
+            std::filesystem::remove(settings.checkpointPath);
+        } else {
+            film.save(settings.checkpointPath, info);
+        }
+    }
+    writer.flush();
+    if constexpr (stats::ENABLED) std::cout << stats::collect().toJson() << std::endl;
+    if (timeline) timeline::stop(settings.timelinePath);
 }
 
 Image::Image(int width, int height) {
@@ -262,12 +875,11 @@ Image::Image(int width, int height) {
 }
 
 Color Image::getPixel(int row, int col) const {
-    const int baseIndex = row * width + col;
-    double r = imgbuf[baseIndex] / 255.0;
-    double g = imgbuf[baseIndex + 1] / 255.0;
-    double b = imgbuf[baseIndex + 2] / 255.0;
-    double a = imgbuf[baseIndex + 3] / 255.0;
-    return Color{r, g, b, a};
+    const int baseIndex = 4 * (row * width + col);
+    Real r = imgbuf[baseIndex] / 255.0;
+    Real g = imgbuf[baseIndex + 1] / 255.0;
+    Real b = imgbuf[baseIndex + 2] / 255.0;
+    return Color{r, g, b};
 }
 
 void Image::setPixel(int row, int col, const Color &color) {
@@ -275,7 +887,7 @@ void Image::setPixel(int row, int col, const Color &color) {
     imgbuf[baseIndex] = static_cast<unsigned char>(255.0 * color.r);
     imgbuf[baseIndex + 1] = static_cast<unsigned char>(255.0 * color.g);
     imgbuf[baseIndex + 2] = static_cast<unsigned char>(255.0 * color.b);
-    imgbuf[baseIndex + 3] = static_cast<unsigned char>(255.0 * color.a);
+    imgbuf[baseIndex + 3] = 255;
 }
 
 int Image::getWidth() const { return width; }
@@ -286,9 +898,38 @@ double Image::aspectRatio() const {
     return static_cast<double>(width) / static_cast<double>(height);
 }
 
+bool Image::load(const std::string &path) {
+    std::vector<unsigned char> decoded;
+    unsigned fileWidth, fileHeight;
+    if (lodepng::decode(decoded, fileWidth, fileHeight, path) != 0 ||
+        fileWidth != static_cast<unsigned>(width) || fileHeight != static_cast<unsigned>(height)) {
+        return false;
+    }
+    imgbuf = std::move(decoded);
+    return true;
+}
+
+void Image::clear() { std::fill(imgbuf.begin(), imgbuf.end(), 0); }
+
+void Image::paste(const unsigned char *pixels, int width, int height, int x, int y) {
+    for (int row = 0; row < height; ++row) {
+        std::copy_n(pixels + 4 * row * width, 4 * width,
+                    imgbuf.begin() + 4 * ((y + row) * this->width + x));
+    }
+}
+
 bool Image::save(const std::string &path) {
-    unsigned error = lodepng::encode(path, imgbuf, static_cast<unsigned>(width),
-                                   static_cast<unsigned>(height));
+    std::vector<unsigned char> png;
+    unsigned error;
+    {
+        timeline::Scope scope("encode");
+        error = lodepng::encode(png, imgbuf, static_cast<unsigned>(width),
+                                static_cast<unsigned>(height));
+    }
+    if (!error) {
+        timeline::Scope scope("write");
+        error = lodepng::save_file(png, path);
+    }
     if (error) {
         std::cout << "Error " << error << ": " << lodepng_error_text(error)
                             << std::endl;
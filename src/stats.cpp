@@ -0,0 +1,62 @@
+#include "stats.h"
+#include <mutex>
+#include <sstream>
+
+namespace stats {
+namespace {
+std::mutex mutex;
+Counters totals;
+
+// Names of the counters, phases and material types in the JSON report.
+const char *COUNTER_NAMES[COUNTERS] = {"primary",   "shadow",           "reflection",
+                                       "refraction", "intersectionTests", "culledTests"};
+const char *PHASE_NAMES[PHASES] = {"sceneBuild", "trace", "encode"};
+const char *MATERIAL_NAMES[MATERIAL_TYPES] = {"matte", "plastic", "polishedMetal", "glass",
+                                              "custom"};
+
+// Write "name": value pairs for a range of entries as the body of an object.
+template <typename T>
+void writeFields(std::ostringstream &out, const char *const *names, const T *values,
+                 size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i) {
+        out << (i > first ? ", " : "") << '"' << names[i] << "\": " << values[i];
+    }
+}
+}  // namespace
+
+void Counters::merge(const Counters &other) {
+    for (size_t i = 0; i < events.size(); ++i) events[i] += other.events[i];
+    for (size_t i = 0; i < shadingCalls.size(); ++i) shadingCalls[i] += other.shadingCalls[i];
+    for (size_t i = 0; i < seconds.size(); ++i) seconds[i] += other.seconds[i];
+}
+
+std::string Counters::toJson() const {
+    std::ostringstream out;
+    out << "{\"rays\": {";
+    writeFields(out, COUNTER_NAMES, events.data(), PrimaryRays, IntersectionTests);
+    out << "}, ";
+    writeFields(out, COUNTER_NAMES, events.data(), IntersectionTests, COUNTERS);
+    out << ", \"shadingCalls\": {";
+    writeFields(out, MATERIAL_NAMES, shadingCalls.data(), 0, MATERIAL_TYPES);
+    out << "}, \"seconds\": {";
+    writeFields(out, PHASE_NAMES, seconds.data(), 0, PHASES);
+    out << "}}";
+    return out.str();
+}
+
+void flush() {
+    if constexpr (!ENABLED) return;
+    Counters &counters = local();
+    std::lock_guard<std::mutex> lock(mutex);
+    totals.merge(counters);
+    counters = Counters{};
+}
+
+Counters collect() {
+    flush();
+    std::lock_guard<std::mutex> lock(mutex);
+    Counters result = totals;
+    totals = Counters{};
+    return result;
+}
+}  // namespace stats
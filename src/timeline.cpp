@@ -0,0 +1,132 @@
+#include "timeline.h"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace timeline {
+namespace detail {
+std::atomic<bool> recording{false};
+}  // namespace detail
+
+namespace {
+struct Event {
+    const char *name;
+    const char *argName;
+    int64_t arg;
+    std::chrono::steady_clock::time_point start, end;
+};
+
+// A ring buffer that one thread at a time records into.
+struct Lane {
+    std::unique_ptr<Event[]> events = std::make_unique<Event[]>(LANE_CAPACITY);
+
+    // The number of events recorded since the timeline was started. Only the
+    // thread that holds the lane writes it.
+    std::atomic<uint64_t> count{0};
+
+    // Whether a thread holds the lane. Guarded by the mutex.
+    bool held = false;
+};
+
+std::mutex mutex;
+std::vector<std::unique_ptr<Lane>> lanes;
+std::chrono::steady_clock::time_point epoch;
+
+// Hands the lane of a thread back when the thread exits.
+struct LaneHandle {
+    Lane *lane = nullptr;
+
+    ~LaneHandle() {
+        if (!lane) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        lane->held = false;
+    }
+};
+
+// Return the lane of the calling thread, taking a free one or creating one the
+// first time the thread records.
+Lane &laneOfThread() {
+    thread_local LaneHandle handle;
+    if (handle.lane) return *handle.lane;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto &lane : lanes) {
+        if (!lane->held) {
+            handle.lane = lane.get();
+            break;
+        }
+    }
+    if (!handle.lane) {
+        lanes.push_back(std::make_unique<Lane>());
+        handle.lane = lanes.back().get();
+    }
+    handle.lane->held = true;
+    return *handle.lane;
+}
+
+// Microseconds from the start of the timeline, the unit of Chrome traces.
+double micros(std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration<double, std::micro>(t - epoch).count();
+}
+}  // namespace
+
+void detail::record(const char *name, const char *argName, int64_t arg,
+                    std::chrono::steady_clock::time_point start,
+                    std::chrono::steady_clock::time_point end) {
+    Lane &lane = laneOfThread();
+    uint64_t i = lane.count.load(std::memory_order_relaxed);
+    lane.events[i % LANE_CAPACITY] = Event{name, argName, arg, start, end};
+    lane.count.store(i + 1, std::memory_order_release);
+}
+
+void start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto &lane : lanes) lane->count.store(0, std::memory_order_relaxed);
+    epoch = std::chrono::steady_clock::now();
+    detail::recording.store(true, std::memory_order_relaxed);
+}
+
+bool stop(const std::string &path) {
+    detail::recording.store(false, std::memory_order_relaxed);
+
+    std::ofstream out(path);
+    if (!out) {
+        std::cout << "Error: could not open " << path << " to write the timeline" << std::endl;
+        return false;
+    }
+
+    // Complete ("X") events on one timeline per lane, each lane named by a
+    // metadata ("M") event.
+    std::lock_guard<std::mutex> lock(mutex);
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool first = true;
+    for (size_t tid = 0; tid < lanes.size(); ++tid) {
+        const Lane &lane = *lanes[tid];
+        out << (first ? "" : ",") << "\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+            << "\"tid\": " << tid << ", \"args\": {\"name\": \"lane " << tid << "\"}}";
+        first = false;
+
+        uint64_t count = lane.count.load(std::memory_order_acquire);
+        uint64_t oldest = count > LANE_CAPACITY ? count - LANE_CAPACITY : 0;
+        for (uint64_t i = oldest; i < count; ++i) {
+            const Event &event = lane.events[i % LANE_CAPACITY];
+            out << ",\n{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1, "
+                << "\"tid\": " << tid << ", \"ts\": " << micros(event.start)
+                << ", \"dur\": " << micros(event.end) - micros(event.start);
+            if (event.argName) out << ", \"args\": {\"" << event.argName << "\": " << event.arg << "}";
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+
+    if (!out) {
+        std::cout << "Error: could not write the timeline to " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+}  // namespace timeline
@@ -1,27 +1,117 @@
 #include "utils.h"
+#include <condition_variable>
+#include <mutex>
 
-Color utils::phong(const std::shared_ptr<Material> &material,
+namespace {
+// Threads that wait for jobs from runOnPool. There is one thread for every
+// hardware thread but the caller's.
+class ThreadPool {
+private:
+  std::mutex mutex;
+  std::condition_variable wake, finished;
+  std::vector<std::thread> threads;
+  const std::function<void()> *job = nullptr;
+  uint64_t generation = 0;
+  int wanted = 0;
+  int running = 0;
+  bool stopping = false;
+
+  void loop() {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      wake.wait(lock, [&] { return stopping || (generation != seen && wanted > 0); });
+      if (stopping) return;
+      seen = generation;
+      --wanted;
+      const std::function<void()> &current = *job;
+      lock.unlock();
+      onPool = true;
+      current();
+      onPool = false;
+      lock.lock();
+      if (--running == 0) finished.notify_all();
+    }
+  }
+
+public:
+  // Whether the calling thread is running a job.
+  static thread_local bool onPool;
+
+  ThreadPool() {
+    int count = static_cast<int>(std::thread::hardware_concurrency()) - 1;
+    for (int t = 0; t < count; ++t) threads.emplace_back([this] { loop(); });
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto &thread : threads) thread.join();
+  }
+
+  int size() const { return static_cast<int>(threads.size()); }
+
+  // Run the job on the calling thread and on helpers threads of the pool.
+  void run(int helpers, const std::function<void()> &task) {
+    helpers = std::min(helpers, size());
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      job = &task;
+      wanted = helpers;
+      running = helpers;
+      ++generation;
+    }
+    wake.notify_all();
+    onPool = true;
+    task();
+    onPool = false;
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&] { return running == 0; });
+    wanted = 0;
+    job = nullptr;
+  }
+};
+
+thread_local bool ThreadPool::onPool = false;
+}  // namespace
+
+void utils::runOnPool(int helpers, const std::function<void()> &job) {
+  if (helpers <= 0 || ThreadPool::onPool) {
+    job();
+    return;
+  }
+  // One job runs at a time; other callers wait for the pool.
+  static std::mutex busy;
+  static ThreadPool pool;
+  std::lock_guard<std::mutex> lock(busy);
+  pool.run(helpers, job);
+}
+
+Color utils::phong(const Material &material,
                    const std::shared_ptr<Light> &light, const Vec3 &L,
                    const Vec3 &V, const Vec3 &N) {
-  Color diffuse = light->color * material->color * material->diffuse *
-                  std::max(0.0, L.dot(N));
+  Color diffuse = light->color * material.color * material.diffuse *
+                  std::max(Real(0), L.dot(N));
   Vec3 halfway = (V + L).normalize();
-  double specularI =
-      std::pow(std::max(0.0, halfway.dot(N)), material->shininess);
-  Color specular = light->color * material->specular * specularI;
+  Real specularI =
+      std::pow(std::max(Real(0), halfway.dot(N)), material.shininess);
+  Color specular = light->color * material.specular * specularI;
   Color final = (diffuse + specular);
   return final;
 }
 
-double utils::fresnel(double cosTheta, double ior) {
+Real utils::fresnel(Real cosTheta, Real ior) {
   float r0 = (1 - ior) / (1 + ior);
   r0 = r0 * r0;
   return r0 + (1 - r0) * std::pow(1 - cosTheta, 5);
 }
 
-double utils::random(double min, double max) {
-  static std::uniform_real_distribution<double> distribution(min, max);
+Real utils::random(Real min, Real max) {
+  static std::uniform_real_distribution<Real> distribution(min, max);
   return distribution(gen);
 }
 
-double utils::random() { return utils::distribution(gen); }
\ No newline at end of file
+Real utils::random() { return utils::distribution(gen); }
\ No newline at end of file
@@ -0,0 +1,371 @@
+#include "wavefront.h"
+#include "utils.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+// The limits and sample counts used by Scene::shade and its helpers.
+const unsigned MAX_DEPTH = 4;
+const unsigned LIGHT_SAMPLES = 5;
+const unsigned SECONDARY_SAMPLES = 6;
+const Real REFLECTION_SPREAD = 0.02;
+const Real TRANSMISSION_SPREAD = 0.10;
+const Real INDEX_OF_REFRACTION = 1.5;
+const Real DEPTH_FALLOFF = 0.3;
+
+// Children of a vertex are numbered 1 to 2 * SECONDARY_SAMPLES within their
+// parent's path, so a path fits four bits per level.
+const std::uint32_t PATH_BITS = 4;
+
+// Sort keys hold the index of a ray in their low bits. A level never holds
+// more than the children of one chunk.
+const unsigned INDEX_BITS = 16;
+static_assert(Wavefront::CHUNK_SIZE * 2 * SECONDARY_SAMPLES <= 1u << INDEX_BITS);
+
+// Bits per axis of the Morton code of a ray origin.
+const unsigned MORTON_BITS = 10;
+
+// Spread the low ten bits of x out so that there are two zero bits between
+// each of them.
+std::uint64_t spreadBits(std::uint64_t x) {
+    x &= 0x3ff;
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x << 8)) & 0x0300f00f;
+    x = (x | (x << 4)) & 0x030c30c3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+}
+
+// Flag the shadow rays that hit something before reaching the light. Misses
+// have t at the largest Real and pass. Branch free so that the loop
+// vectorizes.
+void occluded(size_t n, const Real *__restrict t, const Real *__restrict distance, Real bias,
+              Real *__restrict blocked) {
+    for (size_t i = 0; i < n; ++i) blocked[i] = t[i] + bias < distance[i] ? 1 : 0;
+}
+}  // namespace
+
+void Wavefront::Level::clear() {
+    rays.clear();
+    sample.clear();
+    parent.clear();
+    path.clear();
+    weight.clear();
+}
+
+void Wavefront::Level::push(const Ray &ray, std::uint32_t sample, std::uint32_t parent,
+                            std::uint32_t path, const Color &weight) {
+    rays.push(ray);
+    this->sample.push_back(sample);
+    this->parent.push_back(parent);
+    this->path.push_back(path);
+    this->weight.push_back(weight);
+}
+
+void Wavefront::ShadowQueue::clear() {
+    rays.clear();
+    slot.clear();
+    distance.clear();
+    light.clear();
+}
+
+Wavefront::Wavefront() : levels(MAX_DEPTH + 1) {}
+
+void Wavefront::trace(const Scene &scene, Film &film, const Tile &tile,
+                      const std::vector<unsigned> &count, Sampler &sampler,
+                      const RenderSettings &settings) {
+    this->settings = &settings;
+    left = film.getLeft();
+    top = film.getTop();
+    samples.clear();
+    for (int row = tile.y0; row < tile.y1; ++row) {
+        for (int col = tile.x0; col < tile.x1; ++col) {
+            unsigned n = count[row * film.getWidth() + col];
+            unsigned first = film.count(row, col);
+            for (unsigned s = first; s < first + n; ++s) {
+                samples.push_back(PixelSample{row, col, s});
+                if (samples.size() == CHUNK_SIZE) {
+                    traceBatch(scene, film, sampler);
+                    samples.clear();
+                }
+            }
+        }
+    }
+    if (!samples.empty()) traceBatch(scene, film, sampler);
+}
+
+void Wavefront::traceBatch(const Scene &scene, Film &film, Sampler &sampler) {
+    auto start = std::chrono::steady_clock::now();
+    generate(scene, sampler);
+    traceLevel(scene, 0, sampler);
+
+    // Camera rays that miss keep the background color unclamped, like
+    // Scene::tracePixel.
+    const Level &root = levels[0];
+    for (size_t i = 0; i < root.size(); ++i) {
+        Color color = root.color[i] + root.children[i];
+        if (root.primitive[i] != CompactHit::NONE) color.clamp();
+        const PixelSample &s = samples[root.sample[i]];
+        film.addSample(s.row, s.col, color);
+    }
+
+    if (settings->heatmapPath.empty()) return;
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    double totalRays = 0;
+    for (std::uint32_t rays : sampleRays) totalRays += rays;
+    for (size_t i = 0; i < samples.size(); ++i) {
+        double rays = sampleRays[i];
+        film.addCost(samples[i].row, samples[i].col,
+                     settings->heatmapMetric == RayHeatmap ? rays
+                                                           : elapsed.count() * rays / totalRays);
+    }
+}
+
+void Wavefront::generate(const Scene &scene, Sampler &sampler) {
+    Level &root = levels[0];
+    root.clear();
+    for (std::uint32_t i = 0; i < samples.size(); ++i) {
+        const PixelSample &s = samples[i];
+        sampler.startPixelSample(left + s.col, top + s.row, s.index);
+        Point2 jitter = sampler.get2D();
+        Ray ray = scene.cam.generateRay(top + s.row, left + s.col, jitter,
+                                        scene.cam.hasLens() ? sampler.get2D() : Point2{});
+        root.push(ray, i, i, 1, Color::white());
+    }
+    stats::count(stats::PrimaryRays, samples.size());
+    sampleRays.assign(samples.size(), 1);
+}
+
+void Wavefront::sortLevel(unsigned depth) {
+    Level &level = levels[depth];
+    size_t n = level.size();
+    const RayStream &rays = level.rays;
+
+    Pnt3 lower = rays.get(0).origin, upper = lower;
+    for (size_t i = 1; i < n; ++i) {
+        lower = Pnt3{std::min(lower.x, rays.ox[i]), std::min(lower.y, rays.oy[i]),
+                     std::min(lower.z, rays.oz[i])};
+        upper = Pnt3{std::max(upper.x, rays.ox[i]), std::max(upper.y, rays.oy[i]),
+                     std::max(upper.z, rays.oz[i])};
+    }
+
+    // Map the bounds of the origins onto the grid of the Morton code.
+    Real cells = (1 << MORTON_BITS) - 1;
+    Vec3 extent = upper - lower;
+    Vec3 scale{extent.x > 0 ? cells / extent.x : 0, extent.y > 0 ? cells / extent.y : 0,
+               extent.z > 0 ? cells / extent.z : 0};
+
+    // Rays going the same way are grouped first, and within a group rays that
+    // start close together end up next to each other.
+    keys.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        std::uint64_t octant = (rays.dx[i] < 0) | (rays.dy[i] < 0) << 1 | (rays.dz[i] < 0) << 2;
+        std::uint64_t morton =
+                spreadBits(static_cast<std::uint32_t>((rays.ox[i] - lower.x) * scale.x)) |
+                spreadBits(static_cast<std::uint32_t>((rays.oy[i] - lower.y) * scale.y)) << 1 |
+                spreadBits(static_cast<std::uint32_t>((rays.oz[i] - lower.z) * scale.z)) << 2;
+        std::uint64_t key = octant << (3 * MORTON_BITS) | morton;
+        keys[i] = key << INDEX_BITS | i;
+    }
+    std::sort(keys.begin(), keys.end());
+
+    // Gather the level in the new order. Its vertices have not spawned
+    // anything yet, so no other level refers to them.
+    sorted.clear();
+    for (std::uint64_t key : keys) {
+        size_t i = key & ((1u << INDEX_BITS) - 1);
+        sorted.push(rays.get(i), level.sample[i], level.parent[i], level.path[i], level.weight[i]);
+    }
+    std::swap(level, sorted);
+}
+
+void Wavefront::traceLevel(const Scene &scene, unsigned depth, Sampler &sampler) {
+    // Camera rays are coherent already.
+    if (settings->sortRays && depth > 0 && levels[depth].size() > 1) sortLevel(depth);
+
+    Level &level = levels[depth];
+    size_t n = level.size();
+    level.t.resize(n);
+    level.primitive.resize(n);
+    scene.intersect(level.rays, level.t, level.primitive, Arena::local());
+
+    level.color.assign(n, Viewport::BACKGROUND_COLOR);
+    level.children.assign(n, Color{0, 0, 0});
+    for (size_t first = 0; first < n; first += CHUNK_SIZE) {
+        size_t last = std::min(n, first + CHUNK_SIZE);
+        shade(scene, depth, first, last, sampler);
+        traceShadows(scene, depth, first, last);
+        if (depth < MAX_DEPTH && levels[depth + 1].size() > 0) {
+            traceLevel(scene, depth + 1, sampler);
+            gather(depth + 1);
+        }
+    }
+}
+
+void Wavefront::shade(const Scene &scene, unsigned depth, size_t first, size_t last,
+                      Sampler &sampler) {
+    Level &level = levels[depth];
+    Level *next = depth < MAX_DEPTH ? &levels[depth + 1] : nullptr;
+    if (next) next->clear();
+    shadows.clear();
+
+    // Counting sort of the vertices that hit something by material, so that
+    // the loop below works through one material at a time.
+    const Primitives &primitives = scene.primitives;
+    offsets.assign(scene.materials.size() + 1, 0);
+    for (size_t i = first; i < last; ++i) {
+        if (level.primitive[i] == CompactHit::NONE) continue;
+        offsets[primitives.material(PrimitiveHandle::unpack(level.primitive[i])) + 1]++;
+    }
+    for (size_t m = 1; m < offsets.size(); ++m) offsets[m] += offsets[m - 1];
+    order.resize(offsets.back());
+    for (size_t i = first; i < last; ++i) {
+        if (level.primitive[i] == CompactHit::NONE) continue;
+        MaterialId m = primitives.material(PrimitiveHandle::unpack(level.primitive[i]));
+        order[offsets[m]++] = static_cast<std::uint32_t>(i);
+    }
+
+    // Each vertex gets a dimension per light plus one each for its reflection
+    // and transmission rays.
+    const auto &lights = scene.lights;
+    std::uint32_t dimensions = static_cast<std::uint32_t>(lights.size()) + 2;
+    Real falloff = std::pow(DEPTH_FALLOFF, static_cast<Real>(depth)) / SECONDARY_SAMPLES;
+
+    for (std::uint32_t i : order) {
+        PrimitiveHandle handle = PrimitiveHandle::unpack(level.primitive[i]);
+        const Geometry &geometry = primitives.geometry(handle);
+        const Mat4 &objTransform = geometry.inverse();
+        Ray ray = level.rays.get(i);
+        Pnt3 point = ray.at(level.t[i]);
+        Vec3 normal = Geometry::invertNormal(geometry.normal(objTransform * point), objTransform)
+                              .normalize();
+        Vec3 viewDirection = ray.direction;
+        const Material &material = scene.materials[primitives.material(handle)];
+        stats::countShading(material.type);
+
+        // Ambient light is added by both shade and lighting.
+        level.color[i] = Color::white() * material.ambient * 2;
+
+        const PixelSample &s = samples[level.sample[i]];
+        std::uint32_t base = level.path[i] * dimensions;
+        sampler.startPixelSample(left + s.col, top + s.row, s.index);
+        sampler.setDimension(base);
+        for (std::uint32_t l = 0; l < lights.size(); ++l) {
+            auto squareLight = dynamic_cast<SquareLight *>(lights[l].get());
+            SampleStream stream = sampler.stream2D(LIGHT_SAMPLES);
+            for (unsigned k = 0; k < LIGHT_SAMPLES; ++k) {
+                Point2 u = stream.get(k);
+                Pnt3 lightPoint = squareLight->samplePoint(u.u, u.v);
+                Vec3 lightDirection = lightPoint - point;
+                Real lightDistance = lightDirection.length();
+                lightDirection /= lightDistance;
+                Real attenuation = lights[l]->intensity / (lightDistance * lightDistance);
+
+                shadows.rays.push(Ray{point + lightDirection * Scene::BIAS, lightDirection});
+                shadows.slot.push_back((i - first) * lights.size() + l);
+                shadows.distance.push_back(lightDistance);
+                shadows.light.push_back(utils::phong(material, lights[l], lightDirection,
+                                                     -viewDirection, normal) *
+                                        attenuation);
+            }
+        }
+
+        sampleRays[level.sample[i]] += lights.size() * LIGHT_SAMPLES;
+
+        if (!next) continue;
+        Real cosTheta = Vec3::dot(viewDirection, -normal);
+        std::uint32_t path = level.path[i] << PATH_BITS;
+
+        // Scene::reflection and Scene::transmission start their averages from
+        // Color::black(), which is not zero.
+        if (material.reflectance > 0) {
+            Color weight = material.color * falloff;
+            weight *= material.transparency > 0 ? utils::fresnel(cosTheta, INDEX_OF_REFRACTION)
+                                                : material.reflectance;
+            level.children[i] += Color::black() * weight;
+
+            Vec3 reflectDirection = Vec3::reflect(viewDirection, normal);
+            sampler.setDimension(base + lights.size());
+            SampleStream stream = sampler.stream2D(SECONDARY_SAMPLES);
+            stats::count(stats::ReflectionRays, SECONDARY_SAMPLES);
+            sampleRays[level.sample[i]] += SECONDARY_SAMPLES;
+            for (unsigned k = 0; k < SECONDARY_SAMPLES; ++k) {
+                Point2 u = stream.get(k);
+                Vec3 offset = Vec3::unitSphere(u.u, u.v) * REFLECTION_SPREAD;
+                if (Vec3::dot(offset, normal) < 0) offset = -offset;
+                Vec3 direction = reflectDirection + offset;
+                next->push(Ray{point + direction * Scene::BIAS, direction}, level.sample[i], i,
+                           path + 1 + k, weight);
+            }
+        }
+        if (material.transparency > 0) {
+            // Like Scene::transmission, the Fresnel term uses the normal as
+            // refract leaves it, flipped against the ray when the ray exits.
+            Vec3 refractDirection = Vec3::refract(viewDirection, normal, 1.0, INDEX_OF_REFRACTION);
+            Color weight = material.color * falloff *
+                           (1 - utils::fresnel(Vec3::dot(viewDirection, -normal),
+                                               INDEX_OF_REFRACTION));
+            level.children[i] += Color::black() * weight;
+
+            sampler.setDimension(base + lights.size() + 1);
+            SampleStream stream = sampler.stream2D(SECONDARY_SAMPLES);
+            stats::count(stats::RefractionRays, SECONDARY_SAMPLES);
+            sampleRays[level.sample[i]] += SECONDARY_SAMPLES;
+            for (unsigned k = 0; k < SECONDARY_SAMPLES; ++k) {
+                Point2 u = stream.get(k);
+                Vec3 offset = Vec3::unitSphere(u.u, u.v) * TRANSMISSION_SPREAD;
+                if (Vec3::dot(offset, normal) < 0) offset = -offset;
+                Vec3 direction = refractDirection + offset;
+                next->push(Ray{point + direction * Scene::BIAS, direction}, level.sample[i], i,
+                           path + 1 + SECONDARY_SAMPLES + k, weight);
+            }
+        }
+    }
+}
+
+void Wavefront::traceShadows(const Scene &scene, unsigned depth, size_t first, size_t last) {
+    Level &level = levels[depth];
+    size_t n = shadows.rays.size();
+    size_t lights = scene.lights.size();
+    stats::count(stats::ShadowRays, n);
+    shadows.t.resize(n);
+    shadows.primitive.resize(n);
+    shadows.blocked.resize(n);
+    scene.intersect(shadows.rays, shadows.t, shadows.primitive, Arena::local());
+
+    // The hit is measured from the shaded point, which is BIAS behind the
+    // origin of the shadow ray.
+    occluded(n, shadows.t.data(), shadows.distance.data(), Scene::BIAS, shadows.blocked.data());
+
+    lightSum.assign((last - first) * lights, Color{0, 0, 0});
+    blockedCount.assign((last - first) * lights, 0);
+    for (size_t j = 0; j < n; ++j) {
+        if (shadows.blocked[j]) {
+            blockedCount[shadows.slot[j]]++;
+        } else {
+            lightSum[shadows.slot[j]] += shadows.light[j];
+        }
+    }
+
+    for (size_t i = first; i < last; ++i) {
+        if (level.primitive[i] == CompactHit::NONE) continue;
+        for (size_t l = 0; l < lights; ++l) {
+            size_t slot = (i - first) * lights + l;
+            Real shadowIntensity = static_cast<Real>(blockedCount[slot]) / LIGHT_SAMPLES;
+            level.color[i] += (lightSum[slot] / LIGHT_SAMPLES) * (1 - shadowIntensity);
+        }
+    }
+}
+
+void Wavefront::gather(unsigned depth) {
+    const Level &level = levels[depth];
+    Level &parent = levels[depth - 1];
+    for (size_t i = 0; i < level.size(); ++i) {
+        // Rays that miss contribute the background color, which shade does
+        // not clamp.
+        Color color = level.color[i] + level.children[i];
+        if (level.primitive[i] != CompactHit::NONE) color.clamp();
+        parent.children[level.parent[i]] += color * level.weight[i];
+    }
+}
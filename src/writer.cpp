@@ -0,0 +1,56 @@
+#include "writer.h"
+
+ImageWriter::ImageWriter(int width, int height)
+        : buffers{Image(width, height), Image(width, height)},
+          worker(&ImageWriter::run, this) {}
+
+ImageWriter::~ImageWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    worker.join();
+}
+
+Image &ImageWriter::acquire() {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [this] { return !busy[back]; });
+    return buffers[back];
+}
+
+void ImageWriter::submit(const std::string &path) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        busy[back] = true;
+        jobs.push_back(Job{back, path});
+        back ^= 1;
+    }
+    cv.notify_all();
+}
+
+void ImageWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [this] { return jobs.empty() && !busy[0] && !busy[1]; });
+}
+
+void ImageWriter::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+
+        // Drain the queue before honouring a stop request so that no frame
+        // is lost on shutdown.
+        if (jobs.empty()) return;
+
+        Job job = std::move(jobs.front());
+        jobs.pop_front();
+
+        lock.unlock();
+        buffers[job.buffer].save(job.path);
+        lock.lock();
+
+        busy[job.buffer] = false;
+        cv.notify_all();
+    }
+}